@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_CHUNK_SIZE 8192
+#define ARENA_ALIGN 16
+
+static struct arena_chunk *new_chunk(size_t size) {
+    if (size < ARENA_CHUNK_SIZE) size = ARENA_CHUNK_SIZE;
+    struct arena_chunk *c = malloc(sizeof(*c) + size);
+    if (!c) {
+        perror("arena allocation failed");
+        exit(1);
+    }
+    c->next = NULL;
+    c->size = size;
+    c->used = 0;
+    return c;
+}
+
+void *arena_alloc(struct arena *a, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    if (!a->cur) {
+        if (!a->head) a->head = new_chunk(size);
+        a->cur = a->head;
+    }
+
+    // Move on to a kept chunk that fits, or append a fresh one
+    while (a->cur->size - a->cur->used < size) {
+        if (!a->cur->next) a->cur->next = new_chunk(size);
+        a->cur = a->cur->next;
+    }
+
+    void *p = a->cur->data + a->cur->used;
+    a->cur->used += size;
+    return p;
+}
+
+char *arena_strndup(struct arena *a, const char *s, size_t n) {
+    char *p = arena_alloc(a, n + 1);
+    memcpy(p, s, n);
+    p[n] = '\0';
+    return p;
+}
+
+void arena_reset(struct arena *a) {
+    for (struct arena_chunk *c = a->head; c; c = c->next) c->used = 0;
+    a->cur = a->head;
+}
+
+void arena_free(struct arena *a) {
+    struct arena_chunk *c = a->head;
+    while (c) {
+        struct arena_chunk *next = c->next;
+        free(c);
+        c = next;
+    }
+    a->head = a->cur = NULL;
+}
@@ -0,0 +1,510 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "batch.h"
+#include "execute.h"
+#include "expand.h"
+#include "jobs.h"
+#include "parse.h"
+#include "path.h"
+#include "reader.h"
+#include "stats.h"
+#include "trace.h"
+
+extern int should_exit;
+
+// === Job Slots ===
+// Each job runs in a forked copy of the shell with stdout/stderr captured
+// in memfds, and its output is written out whole once it has finished: in
+// start order for an ordered pool, so the output matches a sequential run
+// (per job, all stdout is emitted before its stderr), or else as jobs
+// finish. In a pool that stops on failure (set -e), a failed job dooms
+// every job started after it: those still running are killed and their
+// output is dropped.
+struct batch_job {
+    pid_t pid;      // 0 once reaped
+    int pidfd;
+    int out_fd;
+    int err_fd;
+    int status;
+    int abandoned;
+};
+
+static void copy_out(int src, int dst) {
+    struct stat st;
+    if (fstat(src, &st) < 0) return;
+
+    off_t off = 0;
+    while (off < st.st_size) {
+        ssize_t n = sendfile(dst, src, &off, st.st_size - off);
+        if (n > 0) continue;
+        if (n < 0 && errno == EINTR) continue;
+        break;
+    }
+
+    // sendfile() refuses some targets (e.g. O_APPEND files); copy the rest
+    char buf[8192];
+    while (off < st.st_size) {
+        ssize_t n = pread(src, buf, sizeof(buf), off);
+        if (n <= 0) break;
+        if (write(dst, buf, n) != n) break;
+        off += n;
+    }
+}
+
+// Write out and retire finished jobs. An unordered pool retires them
+// wherever they are, moving the oldest job into the freed place.
+static void flush_ready(struct slot_pool *p) {
+    for (int i = 0; i < p->count;) {
+        struct batch_job *job = &p->jobs[(p->head + i) % p->capacity];
+        if (job->pid != 0) {
+            if (p->ordered) break;
+            i++;
+            continue;
+        }
+        if (!job->abandoned) {
+            copy_out(job->out_fd, p->out_fd);
+            copy_out(job->err_fd, p->err_fd);
+            last_status = job->status;
+            if (job->status != 0 && p->first_failure == 0) p->first_failure = job->status;
+        }
+        close(job->out_fd);
+        close(job->err_fd);
+        if (i > 0) *job = p->jobs[p->head];
+        p->head = (p->head + 1) % p->capacity;
+        p->count--;
+    }
+}
+
+// set -e: the job at position pos (from head) failed
+static void abandon_after(struct slot_pool *p, int pos) {
+    for (int i = pos + 1; i < p->count; i++) {
+        struct batch_job *job = &p->jobs[(p->head + i) % p->capacity];
+        if (job->pid != 0 && !job->abandoned) kill(job->pid, SIGKILL);
+        job->abandoned = 1;
+    }
+    should_exit = 1;
+}
+
+// Wait for any running slot to finish. Slots are watched through pidfds
+// so background jobs started by barrier lines are never reaped here.
+static void reap_one(struct slot_pool *p) {
+    struct pollfd fds[p->capacity];
+    struct batch_job *owner[p->capacity];
+    int pos[p->capacity];
+    int n = 0;
+
+    for (int i = 0; i < p->count; i++) {
+        struct batch_job *job = &p->jobs[(p->head + i) % p->capacity];
+        if (job->pid == 0) continue;
+        fds[n].fd = job->pidfd;
+        fds[n].events = POLLIN;
+        pos[n] = i;
+        owner[n++] = job;
+    }
+    if (n == 0 || poll(fds, n, -1) < 0) return;
+
+    for (int i = 0; i < n; i++) {
+        if (!(fds[i].revents & (POLLIN | POLLHUP))) continue;
+        struct batch_job *job = owner[i];
+        int status;
+        if (waitpid(job->pid, &status, 0) < 0) status = 1 << 8;
+        close(job->pidfd);
+        job->pid = 0;
+        job->status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        p->running--;
+        if (job->status != 0 && !job->abandoned) {
+            p->failures++;
+            if (p->stop_on_failure) abandon_after(p, pos[i]);
+        }
+    }
+}
+
+void pool_init(struct slot_pool *p, int slots, int out_fd, int err_fd, int ordered) {
+    memset(p, 0, sizeof(*p));
+    // Finished jobs may wait behind a slow earlier one; bound how many
+    p->slots = slots;
+    p->capacity = slots * 4;
+    p->jobs = calloc(p->capacity, sizeof(*p->jobs));
+    if (!p->jobs) {
+        perror("job table allocation failed");
+        exit(1);
+    }
+    p->out_fd = out_fd;
+    p->err_fd = err_fd;
+    p->ordered = ordered;
+}
+
+// Block until a job can be started
+void pool_wait(struct slot_pool *p) {
+    while (p->running == p->slots || p->count == p->capacity) {
+        if (p->running > 0) reap_one(p);
+        flush_ready(p);
+    }
+}
+
+void pool_drain(struct slot_pool *p) {
+    while (p->running > 0) {
+        reap_one(p);
+        flush_ready(p);
+    }
+    flush_ready(p);
+}
+
+void pool_free(struct slot_pool *p) {
+    free(p->jobs);
+    p->jobs = NULL;
+}
+
+// Fork a job for seq, which the child prints echo (len bytes) before
+// running. Call pool_wait first. The job reads /dev/null.
+void pool_start(struct slot_pool *p, const char *echo, size_t len, struct sequence *seq) {
+    struct batch_job *job = &p->jobs[(p->head + p->count) % p->capacity];
+    job->out_fd = memfd_create("batch-stdout", MFD_CLOEXEC);
+    job->err_fd = memfd_create("batch-stderr", MFD_CLOEXEC);
+    if (job->out_fd < 0 || job->err_fd < 0) {
+        perror("memfd_create failed");
+        exit(1);
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork failed");
+        exit(1);
+    }
+
+    if (pid == 0) {
+        reset_jobs_after_fork();
+        // Concurrent jobs must not compete for the shell's stdin
+        int devnull = open("/dev/null", O_RDONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDIN_FILENO);
+            close(devnull);
+        }
+        dup2(job->out_fd, STDOUT_FILENO);
+        dup2(job->err_fd, STDERR_FILENO);
+
+        if (len > 0) {
+            fwrite(echo, 1, len, stdout);
+            fflush(stdout);
+        }
+        int status = run_sequence(seq);
+        fflush(stdout);
+        fflush(stderr);
+        trace_flush();
+        _exit(status);
+    }
+
+    job->pid = pid;
+    job->pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (job->pidfd < 0) {
+        perror("pidfd_open failed");
+        exit(1);
+    }
+    job->status = 0;
+    job->abandoned = 0;
+    p->count++;
+    p->running++;
+}
+
+// === Parallel Batch Mode ===
+// Independent batch lines run in a pool of slots with ordered output.
+// A line that runs a builtin with shell-wide effects (cd, path, exit,
+// wait, ...) runs in the parent once every earlier line has finished, as
+// does one that starts a background job, so later lines can wait for it.
+// Lines with syntax errors are also run in order so their diagnostics
+// land in the right place, and so are lines that read $?.
+static struct slot_pool pool;
+static struct parser batch_parser;
+
+static int is_barrier(struct sequence *seq) {
+    return !seq || sequence_has_side_effects(seq) || sequence_uses_status(seq);
+}
+
+void batch_begin(int max_jobs) {
+    pool_init(&pool, max_jobs, STDOUT_FILENO, STDERR_FILENO, 1);
+}
+
+// Run one already-parsed line: seq is NULL when the line failed to parse
+// and error says why. With a single slot every line runs in the shell.
+void batch_line(const char *line, size_t len, struct sequence *seq, const char *error) {
+    if (should_exit) return;
+    if (pool.slots == 1 || is_barrier(seq)) {
+        pool_drain(&pool);
+        if (should_exit) return;
+        fwrite(line, 1, len, stdout);
+        fflush(stdout);
+        int status = 2;
+        if (seq) {
+            status = run_sequence(seq);
+        } else {
+            fprintf(stderr, "syntax error: %s\n", error);
+            last_status = 2;
+            if (errexit) should_exit = 1;
+        }
+        if (status != 0 && pool.first_failure == 0) pool.first_failure = status;
+        return;
+    }
+
+    pool.stop_on_failure = errexit;
+    pool_wait(&pool);
+    if (should_exit) return;
+    pool_start(&pool, line, len, seq);
+}
+
+// Returns the exit status of the first failing line (in source order), or
+// 0. With a single slot it is the last command's status, as in sh.
+int batch_end() {
+    pool_drain(&pool);
+    pool_free(&pool);
+    return pool.slots == 1 ? last_status : pool.first_failure;
+}
+
+// Run batch lines in up to max_jobs concurrent slots
+int run_batch_parallel(int input, int max_jobs) {
+    struct line_reader reader;
+    const char *line;
+    ssize_t len;
+
+    reader_open(&reader, input);
+    batch_begin(max_jobs);
+    for (;;) {
+        uint64_t t0 = trace_start();
+        len = reader_next(&reader, &line);
+        trace_span("read", t0, NULL, 0);
+        if (should_exit || len <= 0) break;
+
+        t0 = stat_clock();
+        struct sequence *seq = parse_line(&batch_parser, line, len);
+        trace_span("parse", t0, line, len);
+        stat_time(STAT_PARSE, t0);
+        batch_line(line, len, seq, batch_parser.error);
+    }
+    reader_close(&reader);
+    parser_free(&batch_parser);
+    return batch_end();
+}
+
+// === parallel ===
+// parallel [-j N] [-k] [--halt N] command [arg...] [::: item...]
+// Runs the command once per item (the arguments after ':::', else each
+// line of stdin) in up to N slots, N defaulting to the number of CPUs.
+// In the command, {} is the item, {.} the item without its extension,
+// {/} its basename and {#} the job number; a command with none of them
+// gets the item as its last argument. The words are joined and parsed
+// once, like GNU parallel's command line, so a quoted template may hold
+// pipes and redirections. Each job is a copy of that tree with the item
+// put in as a single word, never re-parsed, and executables are looked up
+// in the shell before forking so every job shares its lookup cache.
+// Output is written per job as jobs finish, or in item order with -k.
+// --halt N starts no new jobs once N have failed. The status is the
+// number of failed jobs, at most 101.
+static const char *replacements[] = { "{}", "{.}", "{/}", "{#}" };
+
+static int has_replacement(const char *s) {
+    for (size_t i = 0; i < sizeof(replacements) / sizeof(replacements[0]); i++) {
+        if (strstr(s, replacements[i])) return 1;
+    }
+    return 0;
+}
+
+// Append n bytes of s to out (size tracked in *len), escaping the
+// expansion marker and glob bytes for a command whose words are expanded
+static void put_item(char *out, size_t *len, const char *s, size_t n, int escape) {
+    for (size_t i = 0; i < n; i++) {
+        if (escape && ((s[i] >= SUBST_BEGIN && s[i] <= WORD_ESCAPE) || strchr("*?[]", s[i]))) {
+            if (out) out[*len] = WORD_ESCAPE;
+            (*len)++;
+        }
+        if (out) out[*len] = s[i];
+        (*len)++;
+    }
+}
+
+// w with its replacement strings filled in for item (the seqno-th)
+static char *fill_word(struct arena *a, const char *w, const char *item, long seqno, int escape) {
+    if (!strchr(w, '{')) return (char *)w;
+
+    const char *base = strrchr(item, '/');
+    base = base ? base + 1 : item;
+    const char *dot = strrchr(base, '.');
+    size_t stem = dot && dot != base ? (size_t)(dot - item) : strlen(item);
+    char number[24];
+    snprintf(number, sizeof(number), "%ld", seqno);
+
+    // Measure, then write
+    char *out = NULL;
+    size_t len = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        len = 0;
+        for (const char *p = w; *p;) {
+            if (strncmp(p, "{}", 2) == 0) {
+                put_item(out, &len, item, strlen(item), escape);
+                p += 2;
+            } else if (strncmp(p, "{.}", 3) == 0) {
+                put_item(out, &len, item, stem, escape);
+                p += 3;
+            } else if (strncmp(p, "{/}", 3) == 0) {
+                put_item(out, &len, base, strlen(base), escape);
+                p += 3;
+            } else if (strncmp(p, "{#}", 3) == 0) {
+                put_item(out, &len, number, strlen(number), 0);
+                p += 3;
+            } else {
+                if (out) out[len] = *p;
+                len++;
+                p++;
+            }
+        }
+        if (!out) out = arena_alloc(a, len + 1);
+    }
+    out[len] = '\0';
+    return out;
+}
+
+static void fill_pipeline(struct arena *a, struct pipeline *pl, const char *item, long seqno) {
+    for (int j = 0; j < pl->ncmds; j++) {
+        struct command *cmd = &pl->cmds[j];
+        for (int k = 0; k < cmd->nassigns; k++) {
+            cmd->assigns[k] = fill_word(a, cmd->assigns[k], item, seqno, cmd->expand);
+        }
+        for (int k = 0; k < cmd->argc; k++) {
+            cmd->argv[k] = fill_word(a, cmd->argv[k], item, seqno, cmd->expand);
+        }
+        for (struct redir *r = cmd->redirs; r; r = r->next) {
+            r->target = fill_word(a, r->target, item, seqno, cmd->expand);
+        }
+    }
+    for (int b = 0; b < pl->nbranches; b++) fill_pipeline(a, &pl->branches[b], item, seqno);
+}
+
+static struct sequence *fill_template(struct arena *a, const struct sequence *tmpl,
+                                      const char *item, long seqno) {
+    struct sequence *seq = copy_sequence(a, tmpl);
+    for (int i = 0; i < seq->npipes; i++) fill_pipeline(a, &seq->pipes[i], item, seqno);
+    return seq;
+}
+
+// Resolve the job's executables here so the forked jobs inherit the cache
+static void prime_lookups(const struct sequence *seq) {
+    for (int i = 0; i < seq->npipes; i++) {
+        for (int j = 0; j < seq->pipes[i].ncmds; j++) {
+            const struct command *cmd = &seq->pipes[i].cmds[j];
+            if (cmd->argc > 0 && !cmd->expand && !find_builtin(cmd->argv[0])) {
+                find_executable(cmd->argv[0]);
+            }
+        }
+    }
+}
+
+static int parallel_usage(struct builtin_io *io) {
+    dprintf(io->err, "usage: parallel [-j jobs] [-k] [--halt failures] command [arg...] "
+                     "[::: item...]\n");
+    return 2;
+}
+
+static int parse_positive(const char *s, int *v) {
+    char *end;
+    long n = s ? strtol(s, &end, 10) : 0;
+    if (!s || !*s || *end || n < 1 || n > 1 << 20) return -1;
+    *v = n;
+    return 0;
+}
+
+int builtin_parallel(char **args, struct builtin_io *io) {
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int slots = ncpus > 0 ? ncpus : 1, keep = 0, halt = 0;
+    int i = 1;
+
+    for (; args[i] && args[i][0] == '-'; i++) {
+        const char *a = args[i];
+        if (strcmp(a, "--") == 0) {
+            i++;
+            break;
+        } else if (strcmp(a, "-k") == 0) {
+            keep = 1;
+        } else if (strncmp(a, "-j", 2) == 0) {
+            if (parse_positive(a[2] ? a + 2 : args[++i], &slots) < 0) return parallel_usage(io);
+        } else if (strcmp(a, "--halt") == 0) {
+            if (parse_positive(args[++i], &halt) < 0) return parallel_usage(io);
+        } else {
+            return parallel_usage(io);
+        }
+    }
+
+    // The template runs up to ':::'
+    int first = i, end = i;
+    while (args[end] && strcmp(args[end], ":::") != 0) end++;
+    if (end == first) return parallel_usage(io);
+
+    size_t len = 4;
+    for (int k = first; k < end; k++) len += strlen(args[k]) + 1;
+    char *text = malloc(len);
+    if (!text) {
+        dprintf(io->err, "parallel: out of memory\n");
+        return 1;
+    }
+    char *p = text;
+    for (int k = first; k < end; k++) p += sprintf(p, k > first ? " %s" : "%s", args[k]);
+    if (!has_replacement(text)) p += sprintf(p, " {}");
+
+    struct parser parser = { 0 };
+    struct arena tmpl_arena = { 0 }, scratch = { 0 };
+    struct sequence *seq = parse_line(&parser, text, p - text);
+    if (!seq || seq->npipes == 0) {
+        dprintf(io->err, "parallel: syntax error: %s\n", seq ? "empty command" : parser.error);
+        parser_free(&parser);
+        free(text);
+        return 2;
+    }
+    struct sequence *tmpl = copy_sequence(&tmpl_arena, seq);
+    parser_free(&parser);
+    free(text);
+
+    struct slot_pool jobs;
+    struct line_reader reader;
+    pool_init(&jobs, slots, io->out, io->err, keep);
+    if (!args[end]) reader_open(&reader, io->in);
+
+    for (long seqno = 1; !halt || jobs.failures < halt; seqno++) {
+        const char *item;
+        arena_reset(&scratch);
+        if (args[end]) {
+            if (!args[end + seqno]) break;
+            item = args[end + seqno];
+        } else {
+            const char *line;
+            ssize_t n = reader_next(&reader, &line);
+            if (n <= 0) break;
+            if (line[n - 1] == '\n') n--;
+            item = arena_strndup(&scratch, line, n);
+        }
+
+        struct sequence *job = fill_template(&scratch, tmpl, item, seqno);
+        prime_lookups(job);
+        pool_wait(&jobs);
+        if (halt && jobs.failures >= halt) break;
+        pool_start(&jobs, NULL, 0, job);
+    }
+
+    pool_drain(&jobs);
+    pool_free(&jobs);
+    if (!args[end]) reader_close(&reader);
+    arena_free(&scratch);
+    arena_free(&tmpl_arena);
+    return jobs.failures > 101 ? 101 : jobs.failures;
+}
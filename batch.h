@@ -0,0 +1,39 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+#include "parse.h"
+#include "builtins.h"
+
+// Forked shells running parsed lines concurrently in a fixed number of
+// slots, each job's output captured and written out whole; see batch.c
+struct batch_job;
+
+struct slot_pool {
+    struct batch_job *jobs;     // ring of started, unretired jobs
+    int slots;
+    int capacity;
+    int head;
+    int count;
+    int running;
+    int out_fd;                 // where captured output goes
+    int err_fd;
+    int ordered;                // output in start order, else as jobs finish
+    int stop_on_failure;        // set -e: a failure dooms later jobs
+    int failures;               // jobs that failed so far
+    int first_failure;          // status of the first failure retired
+};
+
+void pool_init(struct slot_pool *p, int slots, int out_fd, int err_fd, int ordered);
+void pool_wait(struct slot_pool *p);
+void pool_start(struct slot_pool *p, const char *echo, size_t len, struct sequence *seq);
+void pool_drain(struct slot_pool *p);
+void pool_free(struct slot_pool *p);
+
+void batch_begin(int max_jobs);
+void batch_line(const char *line, size_t len, struct sequence *seq, const char *error);
+int batch_end();
+int run_batch_parallel(int input, int max_jobs);
+int builtin_parallel(char **args, struct builtin_io *io);
+
+#endif
@@ -0,0 +1,130 @@
+// In-process microbenchmarks for the shell's hot paths: parsing lines of
+// increasing complexity, executable lookup with a cold and a warm cache,
+// and spawn latency of /bin/true with each launch method. An optional
+// ballast argument grows the benchmark's RSS to show how fork cost scales
+// with the parent's page tables.
+//
+// Usage: micro_bench [scale] [ballast_mb]
+// Prints CSV: suite,case,iterations,seconds,ops_per_sec
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "../parse.h"
+#include "../path.h"
+#include "../spawn.h"
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *suite, const char *name, long iterations, double secs) {
+    printf("%s,%s,%ld,%.6f,%.0f\n", suite, name, iterations, secs, iterations / secs);
+    fflush(stdout);
+}
+
+// === Parser ===
+static void bench_parse(const char *name, const char *line, long iterations) {
+    struct parser p = { 0 };
+    size_t len = strlen(line);
+
+    double start = now();
+    for (long i = 0; i < iterations; i++) {
+        struct sequence *seq = parse_line(&p, line, len);
+        if (!seq) {
+            fprintf(stderr, "parse failed: %s: %s\n", name, p.error);
+            exit(1);
+        }
+    }
+    report("parse", name, iterations, now() - start);
+    parser_free(&p);
+}
+
+static void parse_suite(long scale) {
+    bench_parse("simple", "ls -l /tmp\n", scale * 200);
+    bench_parse("quoted", "echo 'single quoted' \"double $quoted\" back\\ slash\n", scale * 200);
+    bench_parse("pipeline", "cat < in.txt | grep -v foo | sort | uniq -c | head -n 5 > out.txt\n",
+                scale * 100);
+    bench_parse("sequence", "cd /tmp; ls; echo a b c; true & false; pwd | cat\n", scale * 100);
+
+    // 4 KiB line of short words
+    char *long_line = malloc(4097);
+    for (int i = 0; i < 4096; i++) long_line[i] = i % 8 == 7 ? ' ' : 'a' + i % 8;
+    long_line[4095] = '\n';
+    long_line[4096] = '\0';
+    bench_parse("long_4k", long_line, scale * 5);
+    free(long_line);
+}
+
+// === Executable Lookup ===
+static void lookup_suite(long scale) {
+    char *names[] = { "ls", "cat", "sh", "true", "no-such-command" };
+    int nnames = sizeof(names) / sizeof(names[0]);
+    long iterations = scale * 5;
+
+    init_path();
+
+    // Cold: every lookup walks the PATH directories
+    double start = now();
+    for (long i = 0; i < iterations; i++) {
+        clear_hash();
+        find_executable(names[i % nnames]);
+    }
+    report("lookup", "cold", iterations, now() - start);
+
+    iterations = scale * 200;
+    start = now();
+    for (long i = 0; i < iterations; i++) find_executable(names[i % nnames]);
+    report("lookup", "warm", iterations, now() - start);
+}
+
+// === Spawn Latency ===
+static void spawn_suite(long scale, int ballast_mb) {
+    static const char *names[] = { "posix_spawn", "fork" };
+    char *argv[] = { "true", NULL };
+    long iterations = scale / 5 > 0 ? scale / 5 : 1;
+
+    if (ballast_mb > 0) {
+        size_t size = (size_t)ballast_mb << 20;
+        char *ballast = malloc(size);
+        if (!ballast) {
+            perror("ballast allocation failed");
+            exit(1);
+        }
+        memset(ballast, 1, size);
+    }
+
+    for (int method = SPAWN_POSIX; method <= SPAWN_FORK; method++) {
+        spawn_method = method;
+        double start = now();
+        for (long i = 0; i < iterations; i++) {
+            pid_t pid = spawn_process("/bin/true", argv, NULL, 0);
+            if (pid < 0) {
+                perror("spawn failed");
+                exit(1);
+            }
+            waitpid(pid, NULL, 0);
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "%s_%dmb", names[method], ballast_mb);
+        report("spawn", name, iterations, now() - start);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    long scale = argc > 1 ? atol(argv[1]) : 10000;
+    int ballast_mb = argc > 2 ? atoi(argv[2]) : 0;
+    if (scale < 1) {
+        fprintf(stderr, "Usage: %s [scale] [ballast_mb]\n", argv[0]);
+        return 1;
+    }
+
+    printf("suite,case,iterations,seconds,ops_per_sec\n");
+    parse_suite(scale);
+    lookup_suite(scale);
+    spawn_suite(scale, ballast_mb);
+    return 0;
+}
@@ -0,0 +1,97 @@
+#!/bin/sh
+# Benchmark suite driven by `make bench`. Runs the in-process
+# microbenchmarks, then pipeline and batch workloads under this shell and
+# under $BENCH_SH for comparison. Results go to stdout and to
+# bench/results.csv and bench/results.json.
+#
+# BENCH_SCALE   microbenchmark scale (default 10000)
+# BENCH_BYTES   bytes pushed through each pipeline (default 1 GiB)
+# BENCH_LINES   batch file sizes in lines (default "10000 100000 1000000")
+# BENCH_SH      reference shell (default /bin/sh)
+set -e
+
+cd "$(dirname "$0")/.."
+SHELL_BIN=./shell
+REF_SH=${BENCH_SH:-/bin/sh}
+SCALE=${BENCH_SCALE:-10000}
+BYTES=${BENCH_BYTES:-1073741824}
+LINES=${BENCH_LINES:-"10000 100000 1000000"}
+CSV=bench/results.csv
+JSON=bench/results.json
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+export SHELL_CACHE_DIR="$WORK/cache"
+export SHELL_HISTFILE="$WORK/history"
+
+now() {
+    date +%s.%N
+}
+
+# time_run <suite> <case> <shell> <units> <cmd...>: one CSV row
+time_run() {
+    suite=$1 name=$2 sh=$3 units=$4
+    shift 4
+    start=$(now)
+    "$@" > /dev/null 2>&1
+    end=$(now)
+    awk -v s="$suite" -v c="$name" -v sh="$sh" -v u="$units" -v a="$start" -v b="$end" \
+        'BEGIN { t = b - a; printf "%s,%s_%s,%d,%.6f,%.0f\n", s, c, sh, u, t, u / t }'
+}
+
+{
+    ./micro_bench "$SCALE"
+
+    # Pipelines: head plus N-1 cat stages moving BYTES bytes
+    for stages in 2 4 8; do
+        line="head -c $BYTES /dev/zero"
+        i=1
+        while [ $i -lt $stages ]; do
+            line="$line | cat"
+            i=$((i + 1))
+        done
+        echo "$line" > "$WORK/pipe$stages"
+        time_run pipeline "${stages}stage" shell "$BYTES" $SHELL_BIN "$WORK/pipe$stages"
+        time_run pipeline "${stages}stage" sh "$BYTES" $REF_SH "$WORK/pipe$stages"
+    done
+
+    # Filters: the usual tail stages over a million-line file
+    awk 'BEGIN { for (i = 0; i < 1000000; i++) print "line " i " of the input" }' > "$WORK/lines"
+    for filter in head:"head -n 500000" wc:"wc -l" grep:"grep -F 77" grepv:"grep -Fv 77"; do
+        echo "cat $WORK/lines | ${filter#*:}" > "$WORK/filter"
+        time_run filter "${filter%%:*}" shell 1000000 $SHELL_BIN "$WORK/filter"
+        time_run filter "${filter%%:*}" sh 1000000 $REF_SH "$WORK/filter"
+    done
+
+    # Batch: builtin-heavy scripts, so shell overhead dominates
+    for n in $LINES; do
+        awk -v n="$n" 'BEGIN {
+            for (i = 0; i < n; i++) {
+                k = i % 5
+                if (k == 0) print "echo line " i
+                else if (k == 1) print "true"
+                else if (k == 2) print "printf \"%s\\n\" a b"
+                else if (k == 3) print "test -n x"
+                else print "pwd"
+            }
+        }' > "$WORK/batch$n"
+        time_run batch "${n}lines" shell "$n" $SHELL_BIN "$WORK/batch$n"
+        $SHELL_BIN -P "$WORK/batch$n" > /dev/null 2>&1
+        time_run batch "${n}lines" shell_compiled "$n" $SHELL_BIN -P "$WORK/batch$n"
+        time_run batch "${n}lines" sh "$n" $REF_SH "$WORK/batch$n"
+    done
+} | tee "$WORK/results.csv"
+
+{
+    echo "suite,case,iterations,seconds,ops_per_sec"
+    grep -v '^suite,' "$WORK/results.csv"
+} > "$CSV"
+
+awk -F, -v date="$(date -u +%Y-%m-%dT%H:%M:%SZ)" -v rev="$(git rev-parse --short HEAD 2>/dev/null || echo unknown)" '
+    NR == 1 { printf "{\"date\":\"%s\",\"commit\":\"%s\",\"results\":[", date, rev; next }
+    { printf "%s\n{\"suite\":\"%s\",\"case\":\"%s\",\"iterations\":%s,\"seconds\":%s,\"ops_per_sec\":%s}",
+             (NR > 2 ? "," : ""), $1, $2, $3, $4, $5 }
+    END { print "\n]}" }
+' "$CSV" > "$JSON"
+
+echo "results written to $CSV and $JSON" >&2
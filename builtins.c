@@ -2,36 +2,207 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include "builtins.h"
 #include "path.h"
+#include "jobs.h"
+#include "history.h"
+#include "execute.h"
+#include "batch.h"
+#include "utils.h"
+#include "filters.h"
+#include "limit.h"
+#include "stats.h"
+#include "env.h"
 
 extern int should_exit;
 
-int handle_builtin(char **args) {
-    if (strcmp(args[0], "cd") == 0) {
-        const char *path = args[1] ? args[1] : getenv("HOME");
-        if (chdir(path) != 0) perror("cd failed");
+// === Shell State Builtins ===
+static int builtin_cd(char **args, struct builtin_io *io) {
+    const char *path = args[1] ? args[1] : env_get("HOME");
+    if (!path || chdir(path) != 0) {
+        dprintf(io->err, "cd failed: %s\n", strerror(path ? errno : ENOENT));
         return 1;
     }
+    return 0;
+}
 
-    if (strcmp(args[0], "exit") == 0) {
-        should_exit = 1;
-        return 1;
-    }
+// exit [status]: the shell exits with status, or with $? when omitted
+static int builtin_exit(char **args, struct builtin_io *io) {
+    should_exit = 1;
+    return args[1] ? atoi(args[1]) & 0xff : last_status;
+}
 
-    if (strcmp(args[0], "path") == 0) {
-        if (!args[1]) {
-            print_path();
-        } else if (strcmp(args[1], "+") == 0) {
-            if (args[2]) add_path(args[2]);
-            else fprintf(stderr, "Usage: path + <dir>\n");
-        } else if (strcmp(args[1], "-") == 0) {
-            if (args[2]) remove_path(args[2]);
-            else fprintf(stderr, "Usage: path - <dir>\n");
+// set -e / set +e: stop at the first failing command (see run_sequence)
+static int builtin_set(char **args, struct builtin_io *io) {
+    if (!args[1]) {
+        dprintf(io->out, "set %ce\n", errexit ? '-' : '+');
+        return 0;
+    }
+    for (int i = 1; args[i]; i++) {
+        if (strcmp(args[i], "-e") == 0) {
+            errexit = 1;
+        } else if (strcmp(args[i], "+e") == 0) {
+            errexit = 0;
         } else {
-            fprintf(stderr, "Usage: path [ + | - ] <dir>\n");
+            dprintf(io->err, "Usage: set [-e | +e]\n");
+            return 2;
         }
-        return 1;
     }
+    return 0;
+}
 
+static int builtin_path(char **args, struct builtin_io *io) {
+    if (!args[1]) {
+        print_path(io->out);
+    } else if (strcmp(args[1], "+") == 0) {
+        if (args[2]) add_path(args[2]);
+        else dprintf(io->err, "Usage: path + <dir>\n");
+    } else if (strcmp(args[1], "-") == 0) {
+        if (args[2]) remove_path(args[2]);
+        else dprintf(io->err, "Usage: path - <dir>\n");
+    } else {
+        dprintf(io->err, "Usage: path [ + | - ] <dir>\n");
+        return 1;
+    }
     return 0;
 }
+
+static int builtin_hash(char **args, struct builtin_io *io) {
+    int status = 0;
+    if (!args[1]) {
+        print_hash(io->out);
+    } else if (strcmp(args[1], "-r") == 0) {
+        clear_hash();
+    } else {
+        for (int i = 1; args[i]; i++) {
+            if (!prime_hash(args[i])) {
+                dprintf(io->err, "hash: %s: not found\n", args[i]);
+                status = 1;
+            }
+        }
+    }
+    return status;
+}
+
+#define HISTORY_LIST_DEFAULT 20
+#define HISTORY_MAX_REPLAY_DEPTH 16
+
+static void out_history_entry(int n, const char *text, size_t len, void *arg) {
+    char num[16];
+    out_write(arg, num, snprintf(num, sizeof(num), "%5d  ", n));
+    out_write(arg, text, len);
+    out_write(arg, "\n", 1);
+}
+
+// myhistory [count] | -c | -e N | -s text | -p prefix
+static int builtin_myhistory(char **args, struct builtin_io *io) {
+    static int replay_depth;
+    struct outbuf o = { .fd = io->out };
+
+    if (args[1] && strcmp(args[1], "-c") == 0) {
+        history_clear();
+        return 0;
+    }
+
+    if (args[1] && strcmp(args[1], "-e") == 0) {
+        if (!args[2]) {
+            dprintf(io->err, "Usage: myhistory -e <number>\n");
+            return 2;
+        }
+        int n = atoi(args[2]);
+        size_t len;
+        const char *text = history_get(n, &len);
+        const char *error;
+        struct sequence *seq = history_sequence(n, &error);
+        if (!seq) {
+            dprintf(io->err, "myhistory: %s: %s\n", args[2], error);
+            return 1;
+        }
+        if (replay_depth >= HISTORY_MAX_REPLAY_DEPTH) {
+            dprintf(io->err, "myhistory: replay nested too deeply\n");
+            return 1;
+        }
+        out_write(&o, text, len);
+        out_write(&o, "\n", 1);
+        out_flush(&o);
+
+        replay_depth++;
+        int status = run_sequence(seq);
+        replay_depth--;
+        return status;
+    }
+
+    if (args[1] && (strcmp(args[1], "-s") == 0 || strcmp(args[1], "-p") == 0)) {
+        if (!args[2]) {
+            dprintf(io->err, "Usage: myhistory %s <text>\n", args[1]);
+            return 2;
+        }
+        int found = history_search(args[2], args[1][1] == 'p', out_history_entry, &o);
+        out_flush(&o);
+        return found ? 0 : 1;
+    }
+
+    int count = HISTORY_LIST_DEFAULT;
+    if (args[1]) {
+        count = atoi(args[1]);
+        if (count <= 0) {
+            dprintf(io->err, "Usage: myhistory [count | -c | -e N | -s text | -p prefix]\n");
+            return 2;
+        }
+    }
+    int last = history_last();
+    int first = last - count + 1;
+    if (first < history_first()) first = history_first();
+    for (int n = first; n <= last; n++) {
+        size_t len;
+        const char *text = history_get(n, &len);
+        out_history_entry(n, text, len, &o);
+    }
+    out_flush(&o);
+    return o.failed;
+}
+
+// === Dispatch ===
+// Sorted by name for binary search
+static const struct builtin builtins[] = {
+    { "[", builtin_test, BI_PURE },
+    { "bg", builtin_bg, 0 },
+    { "cat", builtin_cat, BI_PURE, cat_operands },
+    { "cd", builtin_cd, 0 },
+    { "echo", builtin_echo, BI_PURE },
+    { "exit", builtin_exit, 0 },
+    { "export", builtin_export, 0 },
+    { "false", builtin_false, BI_PURE },
+    { "fg", builtin_fg, 0 },
+    { "grep", builtin_grep, BI_PURE, grep_operands },
+    { "hash", builtin_hash, 0 },
+    { "head", builtin_head, BI_PURE, head_operands },
+    { "jobs", builtin_jobs, 0 },
+    { "limit", builtin_limit, 0 },
+    { "myhistory", builtin_myhistory, 0 },
+    { "parallel", builtin_parallel, 0 },
+    { "path", builtin_path, 0 },
+    { "printf", builtin_printf, BI_PURE },
+    { "pwd", builtin_pwd, BI_PURE },
+    { "set", builtin_set, 0 },
+    { "shellstat", builtin_shellstat, 0 },
+    { "tee", builtin_tee, BI_PURE, tee_operands },
+    { "test", builtin_test, BI_PURE },
+    { "true", builtin_true, BI_PURE },
+    { "unset", builtin_unset, 0 },
+    { "wait", builtin_wait, 0 },
+    { "wc", builtin_wc, BI_PURE, wc_operands },
+};
+
+const struct builtin *find_builtin(const char *name) {
+    int lo = 0, hi = sizeof(builtins) / sizeof(builtins[0]) - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = strcmp(name, builtins[mid].name);
+        if (cmp == 0) return &builtins[mid];
+        if (cmp < 0) hi = mid - 1;
+        else lo = mid + 1;
+    }
+    return NULL;
+}
@@ -1,6 +1,30 @@
 #ifndef BUILTINS_H
 #define BUILTINS_H
 
-int handle_builtin(char **args);
+// Descriptors a builtin reads from and writes to. They already reflect
+// the command's redirections and pipes; builtins never touch fds 0-2
+// directly, so several can run at once as pipeline-stage threads.
+struct builtin_io {
+    int in;
+    int out;
+    int err;
+};
 
-#endif
\ No newline at end of file
+// No effect on shell state: may run as a thread inside a pipeline and
+// in a parallel batch job
+#define BI_PURE 1
+
+struct builtin {
+    const char *name;
+    int (*fn)(char **args, struct builtin_io *io);
+    int flags;
+    // For utilities that also exist as external commands: -1 if args need
+    // something the builtin does not implement (an option, a device or
+    // pipe operand), else whether they name files to read. When it says
+    // -1, or 0 with only the terminal on stdin, the external command runs.
+    int (*operands)(char **args);
+};
+
+const struct builtin *find_builtin(const char *name);
+
+#endif
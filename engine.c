@@ -0,0 +1,644 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "shellengine.h"
+#include "parse.h"
+#include "spawn.h"
+#include "utils.h"
+#include "filters.h"
+
+// Entry points exported from libshellengine.so; everything else is built
+// with hidden visibility
+#define ENGINE_API __attribute__((visibility("default")))
+
+#define ENGINE_PUMP_BUFFER 65536
+#define ENGINE_NOT_FOUND 127
+
+// === Engine State ===
+// Everything a line can observe or change lives here, so engines are
+// independent. The working directory is kept as a path (for children,
+// via posix_spawn's chdir action) and an O_PATH descriptor (for lookups
+// and redirections with the *at() calls); the process cwd is never used.
+struct shell_engine {
+    char **paths;
+    int npaths;
+    char *cwd;
+    int cwd_fd;
+    int devnull;
+    int in_fd, out_fd, err_fd;
+    shell_output_fn output;
+    void *output_ctx;
+    struct parser parser;
+    int last_status;    // previous pipeline's, for a bare 'exit'
+    int exit_requested;
+    int exit_status;
+};
+
+// State builtins. In a multi-stage pipeline they run on a thread with
+// apply == 0 and, as in sh, leave the engine unchanged.
+struct engine_builtin {
+    const char *name;
+    int (*fn)(struct shell_engine *e, char **args, struct builtin_io *io, int apply);
+};
+
+static void free_paths(struct shell_engine *e) {
+    for (int i = 0; i < e->npaths; i++) free(e->paths[i]);
+    free(e->paths);
+    e->paths = NULL;
+    e->npaths = 0;
+}
+
+static int add_path(struct shell_engine *e, const char *dir, size_t len) {
+    char **paths = realloc(e->paths, (e->npaths + 1) * sizeof(char *));
+    if (!paths) return -1;
+    e->paths = paths;
+    if (!(e->paths[e->npaths] = strndup(dir, len))) return -1;
+    e->npaths++;
+    return 0;
+}
+
+ENGINE_API int shell_engine_set_path(struct shell_engine *e, const char *path) {
+    if (!path) path = getenv("PATH");
+    free_paths(e);
+    if (!path) return 0;
+
+    while (*path) {
+        const char *end = strchrnul(path, ':');
+        if (end > path && add_path(e, path, end - path) < 0) return -1;
+        path = *end ? end + 1 : end;
+    }
+    return 0;
+}
+
+ENGINE_API int shell_engine_chdir(struct shell_engine *e, const char *dir) {
+    char joined[PATH_MAX], resolved[PATH_MAX];
+
+    if (dir[0] != '/' && e->cwd) {
+        if (snprintf(joined, sizeof(joined), "%s/%s", e->cwd, dir) >= (int)sizeof(joined)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        dir = joined;
+    }
+    if (!realpath(dir, resolved)) return -1;
+
+    int fd = open(resolved, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    char *copy = strdup(resolved);
+    if (!copy) {
+        close(fd);
+        return -1;
+    }
+    if (e->cwd_fd >= 0) close(e->cwd_fd);
+    free(e->cwd);
+    e->cwd_fd = fd;
+    e->cwd = copy;
+    return 0;
+}
+
+ENGINE_API const char *shell_engine_cwd(struct shell_engine *e) {
+    return e->cwd;
+}
+
+ENGINE_API void shell_engine_set_fds(struct shell_engine *e, int in_fd, int out_fd, int err_fd) {
+    e->in_fd = in_fd;
+    e->out_fd = out_fd;
+    e->err_fd = err_fd;
+}
+
+ENGINE_API void shell_engine_set_output(struct shell_engine *e, shell_output_fn fn, void *ctx) {
+    e->output = fn;
+    e->output_ctx = ctx;
+}
+
+ENGINE_API struct shell_engine *shell_engine_new() {
+    struct shell_engine *e = calloc(1, sizeof(*e));
+    if (!e) return NULL;
+    e->cwd_fd = -1;
+    e->in_fd = e->out_fd = e->err_fd = -1;
+
+    char cwd[PATH_MAX];
+    e->devnull = open("/dev/null", O_RDWR | O_CLOEXEC);
+    if (e->devnull < 0 || !getcwd(cwd, sizeof(cwd)) || shell_engine_chdir(e, cwd) < 0 ||
+        shell_engine_set_path(e, NULL) < 0) {
+        shell_engine_free(e);
+        return NULL;
+    }
+    return e;
+}
+
+ENGINE_API void shell_engine_free(struct shell_engine *e) {
+    if (!e) return;
+    free_paths(e);
+    free(e->cwd);
+    if (e->cwd_fd >= 0) close(e->cwd_fd);
+    if (e->devnull >= 0) close(e->devnull);
+    parser_free(&e->parser);
+    free(e);
+}
+
+// === Builtins ===
+static int engine_cd(struct shell_engine *e, char **args, struct builtin_io *io, int apply) {
+    const char *dir = args[1] ? args[1] : getenv("HOME");
+    if (!dir) {
+        dprintf(io->err, "cd failed: %s\n", strerror(ENOENT));
+        return 1;
+    }
+    if (!apply) return 0;
+    if (shell_engine_chdir(e, dir) < 0) {
+        dprintf(io->err, "cd failed: %s\n", strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+static int engine_exit(struct shell_engine *e, char **args, struct builtin_io *io, int apply) {
+    int status = args[1] ? atoi(args[1]) & 0xff : e->last_status;
+    if (apply) {
+        e->exit_requested = 1;
+        e->exit_status = status;
+    }
+    return status;
+}
+
+static int engine_path(struct shell_engine *e, char **args, struct builtin_io *io, int apply) {
+    struct outbuf o = { .fd = io->out };
+
+    if (!args[1]) {
+        for (int i = 0; i < e->npaths; i++) {
+            if (i > 0) out_write(&o, ":", 1);
+            out_str(&o, e->paths[i]);
+        }
+        out_write(&o, "\n", 1);
+        out_flush(&o);
+        return o.failed;
+    }
+    if ((strcmp(args[1], "+") != 0 && strcmp(args[1], "-") != 0) || !args[2]) {
+        dprintf(io->err, "Usage: path [ + | - ] <dir>\n");
+        return 1;
+    }
+    if (!apply) return 0;
+
+    if (args[1][0] == '+') return add_path(e, args[2], strlen(args[2])) < 0;
+    for (int i = 0; i < e->npaths; i++) {
+        if (strcmp(e->paths[i], args[2]) != 0) continue;
+        free(e->paths[i]);
+        memmove(e->paths + i, e->paths + i + 1, (e->npaths - i - 1) * sizeof(char *));
+        e->npaths--;
+        break;
+    }
+    return 0;
+}
+
+static int engine_pwd(struct shell_engine *e, char **args, struct builtin_io *io, int apply) {
+    struct outbuf o = { .fd = io->out };
+    out_str(&o, e->cwd);
+    out_write(&o, "\n", 1);
+    out_flush(&o);
+    return o.failed;
+}
+
+// Both tables are sorted by name for binary search
+static const struct engine_builtin engine_builtins[] = {
+    { "cd", engine_cd },
+    { "exit", engine_exit },
+    { "path", engine_path },
+    { "pwd", engine_pwd },
+};
+
+// Utilities with an operands check open files relative to the process cwd,
+// so they are used only when they read nothing but stdin. tee writes
+// files, so it always runs externally.
+static const struct builtin engine_utilities[] = {
+    { "[", builtin_test, BI_PURE },
+    { "cat", builtin_cat, BI_PURE, cat_operands },
+    { "echo", builtin_echo, BI_PURE },
+    { "false", builtin_false, BI_PURE },
+    { "grep", builtin_grep, BI_PURE, grep_operands },
+    { "head", builtin_head, BI_PURE, head_operands },
+    { "printf", builtin_printf, BI_PURE },
+    { "test", builtin_test, BI_PURE },
+    { "true", builtin_true, BI_PURE },
+    { "wc", builtin_wc, BI_PURE, wc_operands },
+};
+
+static int find_index(const char *name, const void *table, size_t n, size_t size) {
+    int lo = 0, hi = n - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = strcmp(name, *(const char **)((const char *)table + mid * size));
+        if (cmp == 0) return mid;
+        if (cmp < 0) hi = mid - 1;
+        else lo = mid + 1;
+    }
+    return -1;
+}
+
+// === Execution ===
+// Builtin stages run on threads that own duplicates of their descriptors
+// and close them when done, which is what lets neighbouring stages see
+// EOF. SIGPIPE is blocked on these threads so a closed reader yields
+// EPIPE instead of killing the host process.
+struct engine_thread {
+    pthread_t tid;
+    int started;
+    struct shell_engine *e;
+    const struct engine_builtin *eb;
+    const struct builtin *util;
+    char **argv;
+    struct builtin_io io;
+    int status;
+};
+
+static void *engine_thread_main(void *arg) {
+    struct engine_thread *th = arg;
+    sigset_t pipe_mask;
+    sigemptyset(&pipe_mask);
+    sigaddset(&pipe_mask, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_mask, NULL);
+
+    if (th->eb) th->status = th->eb->fn(th->e, th->argv, &th->io, 0);
+    else th->status = th->util->fn(th->argv, &th->io);
+    close(th->io.in);
+    close(th->io.out);
+    close(th->io.err);
+    return NULL;
+}
+
+static int start_engine_thread(struct engine_thread *th, int in, int out, int err) {
+    th->io.in = fcntl(in, F_DUPFD_CLOEXEC, 3);
+    th->io.out = fcntl(out, F_DUPFD_CLOEXEC, 3);
+    th->io.err = fcntl(err, F_DUPFD_CLOEXEC, 3);
+    if (th->io.in < 0 || th->io.out < 0 || th->io.err < 0 ||
+        pthread_create(&th->tid, NULL, engine_thread_main, th) != 0) {
+        if (th->io.in >= 0) close(th->io.in);
+        if (th->io.out >= 0) close(th->io.out);
+        if (th->io.err >= 0) close(th->io.err);
+        dprintf(err, "builtin stage failed\n");
+        return -1;
+    }
+    th->started = 1;
+    return 0;
+}
+
+// A single-stage state builtin runs on the calling thread; keep a write
+// to a closed pipe from raising SIGPIPE in the host
+static int run_inline(struct shell_engine *e, const struct engine_builtin *eb, char **argv,
+                      struct builtin_io *io) {
+    sigset_t pipe_mask, old;
+    sigemptyset(&pipe_mask);
+    sigaddset(&pipe_mask, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_mask, &old);
+
+    int status = eb->fn(e, argv, io, 1);
+
+    struct timespec zero = { 0, 0 };
+    while (sigtimedwait(&pipe_mask, NULL, &zero) > 0) {}
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return status;
+}
+
+// Resolve cmd against the engine's PATH and cwd into buf
+static const char *find_command(struct shell_engine *e, const char *cmd, char *buf, size_t size) {
+    struct stat st;
+
+    if (strchr(cmd, '/')) {
+        if (faccessat(e->cwd_fd, cmd, X_OK, 0) == 0) return cmd;
+        return NULL;
+    }
+    for (int i = 0; i < e->npaths; i++) {
+        if (snprintf(buf, size, "%s/%s", e->paths[i], cmd) >= (int)size) continue;
+        if (faccessat(e->cwd_fd, buf, X_OK, 0) == 0 &&
+            fstatat(e->cwd_fd, buf, &st, 0) == 0 && !S_ISDIR(st.st_mode)) {
+            return buf;
+        }
+    }
+    return NULL;
+}
+
+// Open a command's redirections relative to the engine's cwd, left to
+// right as the shell does; '2>&1' duplicates stdout as it stands (an
+// earlier '>' target or stage_out). On failure everything opened so far
+// is closed and -1 returned.
+static int open_engine_redirects(struct shell_engine *e, struct redir *r, int fds[3],
+                                 int stage_out, int err) {
+    fds[0] = fds[1] = fds[2] = -1;
+    for (; r; r = r->next) {
+        int fd;
+        if (r->type == REDIR_IN) {
+            fd = openat(e->cwd_fd, r->target, O_RDONLY | O_CLOEXEC);
+        } else if (r->type == REDIR_ERR_TO_OUT) {
+            fd = fcntl(fds[1] >= 0 ? fds[1] : stage_out, F_DUPFD_CLOEXEC, 3);
+        } else if (r->type == REDIR_OUT_TO_ERR) {
+            fd = fcntl(fds[2] >= 0 ? fds[2] : err, F_DUPFD_CLOEXEC, 3);
+        } else {
+            int mode = redir_appends(r->type) ? O_APPEND : O_TRUNC;
+            fd = openat(e->cwd_fd, r->target, O_WRONLY | O_CREAT | O_CLOEXEC | mode, 0644);
+        }
+        if (fd < 0) {
+            dprintf(err, "%s redirection failed: %s: %s\n",
+                    r->type == REDIR_IN ? "input" : "output", r->target, strerror(errno));
+            break;
+        }
+
+        int slot = redir_fd(r->type);
+        if (fds[slot] >= 0) close(fds[slot]);
+        fds[slot] = fd;
+        if (r->type == REDIR_ALL || r->type == REDIR_ALL_APPEND) {
+            if (fds[2] >= 0) close(fds[2]);
+            fds[2] = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+            if (fds[2] < 0) {
+                dprintf(err, "output redirection failed: %s: %s\n", r->target, strerror(errno));
+                break;
+            }
+        }
+    }
+    if (!r) return 0;
+    for (int i = 0; i < 3; i++) {
+        if (fds[i] >= 0) close(fds[i]);
+        fds[i] = -1;
+    }
+    return -1;
+}
+
+static void add_rusage(struct shell_result *r, const struct rusage *ru) {
+    r->user_seconds += ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1e6;
+    r->sys_seconds += ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1e6;
+    if (ru->ru_maxrss > r->max_rss_kb) r->max_rss_kb = ru->ru_maxrss;
+}
+
+static int has_assignments(const struct pipeline *pl) {
+    for (int i = 0; i < pl->ncmds; i++) {
+        if (pl->cmds[i].nassigns) return 1;
+    }
+    return 0;
+}
+
+// Start every stage, then wait for all of them. Processes stay in the
+// caller's process group and are reaped by pid, so the host's other
+// children are never touched. Returns the last stage's status, or -1 with
+// errno set if a child could not be waited for (as when the host ignores
+// SIGCHLD, and children are reaped before their status is read).
+static int run_engine_pipeline(struct shell_engine *e, struct pipeline *pl,
+                               int in, int out, int err, struct shell_result *r) {
+    int n = pl->ncmds;
+    pid_t *pids = calloc(n, sizeof(*pids));
+    struct engine_thread *threads = calloc(n, sizeof(*threads));
+    if (!pids || !threads) {
+        free(pids);
+        free(threads);
+        dprintf(err, "pipeline allocation failed\n");
+        return 1;
+    }
+
+    int last_status = 0;
+    int prev = -1;
+    for (int i = 0; i < n; i++) {
+        struct command *cmd = &pl->cmds[i];
+        int pipes[2] = { -1, -1 };
+        if (i < n - 1 && pipe2(pipes, O_CLOEXEC) < 0) {
+            dprintf(err, "pipe failed: %s\n", strerror(errno));
+            last_status = 1;
+            break;
+        }
+
+        int stage_in = i == 0 ? in : prev;
+        int stage_out = i == n - 1 ? out : pipes[1];
+        int stage_err = err;
+        int redir[3];
+        int status = 0;
+        if (open_engine_redirects(e, cmd->redirs, redir, stage_out, err) < 0) {
+            status = 1;
+        } else {
+            if (redir[0] >= 0) stage_in = redir[0];
+            if (redir[1] >= 0) stage_out = redir[1];
+            if (redir[2] >= 0) stage_err = redir[2];
+
+            int eb = -1, util = -1;
+            if (cmd->argc > 0) {
+                eb = find_index(cmd->argv[0], engine_builtins,
+                                sizeof(engine_builtins) / sizeof(engine_builtins[0]),
+                                sizeof(engine_builtins[0]));
+            }
+            if (cmd->argc > 0 && eb < 0) {
+                util = find_index(cmd->argv[0], engine_utilities,
+                                  sizeof(engine_utilities) / sizeof(engine_utilities[0]),
+                                  sizeof(engine_utilities[0]));
+            }
+            if (util >= 0 && engine_utilities[util].operands &&
+                engine_utilities[util].operands(cmd->argv) != 0) {
+                util = -1;
+            }
+            if (cmd->argc == 0) {
+                status = 0;
+            } else if (eb >= 0 && n == 1) {
+                struct builtin_io io = { stage_in, stage_out, stage_err };
+                status = run_inline(e, &engine_builtins[eb], cmd->argv, &io);
+            } else if (eb >= 0 || util >= 0) {
+                struct engine_thread *th = &threads[i];
+                th->e = e;
+                th->eb = eb >= 0 ? &engine_builtins[eb] : NULL;
+                th->util = util >= 0 ? &engine_utilities[util] : NULL;
+                th->argv = cmd->argv;
+                status = start_engine_thread(th, stage_in, stage_out, stage_err) < 0;
+            } else {
+                char buf[PATH_MAX];
+                const char *path = find_command(e, cmd->argv[0], buf, sizeof(buf));
+                if (!path) {
+                    dprintf(err, "command not found: %s\n", cmd->argv[0]);
+                    status = ENGINE_NOT_FOUND;
+                } else {
+                    struct spawn_io io = { stage_in, stage_out, stage_err, e->cwd };
+                    pids[i] = spawn_process(path, cmd->argv, &io, -1);
+                    if (pids[i] < 0) {
+                        dprintf(err, "spawn failed: %s: %s\n", cmd->argv[0], strerror(errno));
+                        pids[i] = 0;
+                        status = 126;
+                    }
+                }
+            }
+            for (int k = 0; k < 3; k++) {
+                if (redir[k] >= 0) close(redir[k]);
+            }
+        }
+        if (i == n - 1) last_status = status;
+
+        if (prev >= 0) close(prev);
+        if (pipes[1] >= 0) close(pipes[1]);
+        prev = pipes[0];
+    }
+    if (prev >= 0) close(prev);
+
+    int wait_error = 0;
+    for (int i = 0; i < n; i++) {
+        if (pids[i] > 0) {
+            int status = 0;
+            struct rusage ru = { 0 };
+            pid_t w;
+            while ((w = wait4(pids[i], &status, 0, &ru)) < 0 && errno == EINTR) {}
+            if (w < 0) {
+                wait_error = errno;
+            } else {
+                add_rusage(r, &ru);
+                if (i == n - 1) {
+                    last_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+                    r->signal = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+                }
+            }
+        }
+        if (threads[i].started) {
+            pthread_join(threads[i].tid, NULL);
+            if (i == n - 1) last_status = threads[i].status;
+        }
+    }
+    free(pids);
+    free(threads);
+    if (wait_error) {
+        errno = wait_error;
+        return -1;
+    }
+    return last_status;
+}
+
+// === Output Callbacks ===
+// With a callback set, a run's stdout and stderr are pipes drained by one
+// pump thread, so commands never block on output the caller has not read.
+struct pump {
+    pthread_t tid;
+    int fds[2];
+    struct shell_engine *e;
+};
+
+static void *pump_main(void *arg) {
+    struct pump *p = arg;
+    struct pollfd pfd[2] = { { p->fds[0], POLLIN, 0 }, { p->fds[1], POLLIN, 0 } };
+    char *buf = malloc(ENGINE_PUMP_BUFFER);
+    int open_fds = 2;
+
+    while (buf && open_fds > 0) {
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < 2; i++) {
+            if (pfd[i].fd < 0 || !pfd[i].revents) continue;
+            ssize_t n = read(pfd[i].fd, buf, ENGINE_PUMP_BUFFER);
+            if (n > 0) {
+                p->e->output(p->e->output_ctx, i + 1, buf, n);
+            } else if (n == 0 || errno != EINTR) {
+                pfd[i].fd = -1;
+                open_fds--;
+            }
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+ENGINE_API int shell_engine_run(struct shell_engine *e, const char *line, size_t len,
+                                struct shell_result *result) {
+    struct shell_result r = { 0 };
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int in = e->in_fd >= 0 ? e->in_fd : e->devnull;
+    int out = e->out_fd >= 0 ? e->out_fd : STDOUT_FILENO;
+    int err = e->err_fd >= 0 ? e->err_fd : STDERR_FILENO;
+
+    struct pump pump = { .e = e };
+    int out_pipe[2], err_pipe[2];
+    if (e->output) {
+        if (pipe2(out_pipe, O_CLOEXEC) < 0) return -1;
+        if (pipe2(err_pipe, O_CLOEXEC) < 0) {
+            close(out_pipe[0]);
+            close(out_pipe[1]);
+            return -1;
+        }
+        pump.fds[0] = out_pipe[0];
+        pump.fds[1] = err_pipe[0];
+        if ((errno = pthread_create(&pump.tid, NULL, pump_main, &pump)) != 0) {
+            close(out_pipe[0]);
+            close(out_pipe[1]);
+            close(err_pipe[0]);
+            close(err_pipe[1]);
+            return -1;
+        }
+        out = out_pipe[1];
+        err = err_pipe[1];
+    }
+
+    int failed = 0;     // errno of a child that could not be waited for
+    e->exit_requested = 0;
+    struct sequence *seq = parse_line(&e->parser, line, len);
+    if (!seq) {
+        dprintf(err, "syntax error: %s\n", e->parser.error);
+        r.status = 2;
+    } else {
+        for (int i = 0; i < seq->npipes && !e->exit_requested; i++) {
+            struct pipeline *pl = &seq->pipes[i];
+            e->last_status = r.status;
+            if ((pl->run_if == RUN_IF_OK && r.status != 0) ||
+                (pl->run_if == RUN_IF_FAILED && r.status == 0)) {
+                continue;
+            }
+            r.signal = 0;
+            if (pl->background) {
+                dprintf(err, "background jobs are not supported\n");
+                r.status = 2;
+                continue;
+            }
+            if (pl->nbranches) {
+                dprintf(err, "fan-out is not supported\n");
+                r.status = 2;
+                continue;
+            }
+            if (has_assignments(pl)) {
+                dprintf(err, "variable assignments are not supported\n");
+                r.status = 2;
+                continue;
+            }
+            if (pipeline_expands(pl)) {
+                dprintf(err, "word expansion is not supported\n");
+                r.status = 2;
+                continue;
+            }
+            r.status = run_engine_pipeline(e, pl, in, out, err, &r);
+            if (r.status < 0) {
+                failed = errno;
+                break;
+            }
+        }
+    }
+
+    if (e->output) {
+        close(out_pipe[1]);
+        close(err_pipe[1]);
+        pthread_join(pump.tid, NULL);
+        close(out_pipe[0]);
+        close(err_pipe[0]);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    r.real_seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    r.exit_requested = e->exit_requested;
+    if (e->exit_requested) r.status = e->exit_status;
+    if (result) *result = r;
+    if (failed) {
+        errno = failed;
+        return -1;
+    }
+    return r.status;
+}
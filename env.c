@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "env.h"
+#include "path.h"
+#include "utils.h"
+
+extern char **environ;
+
+// === Environment ===
+// The shell's variables are its environment: a NULL-terminated array of
+// "NAME=value" strings, read from environ at startup and edited in place
+// by export, unset and bare NAME=value commands. Children are spawned
+// with the array itself, so a launch copies nothing unless the command
+// has assignments of its own. PATH and path_list mirror each other:
+// setting PATH reloads path_list, and 'path +'/'path -' set PATH.
+static char **vars;
+static int nvars;
+static int vars_cap;
+
+// The length of the variable name s starts with, 0 if it does not start
+// with one
+size_t name_length(const char *s) {
+    size_t n = 0;
+    if (!(s[0] == '_' || (s[0] >= 'a' && s[0] <= 'z') || (s[0] >= 'A' && s[0] <= 'Z'))) return 0;
+    while (s[n] == '_' || (s[n] >= 'a' && s[n] <= 'z') || (s[n] >= 'A' && s[n] <= 'Z') ||
+           (s[n] >= '0' && s[n] <= '9')) {
+        n++;
+    }
+    return n;
+}
+
+static int find_var(const char *name, size_t n) {
+    for (int i = 0; i < nvars; i++) {
+        if (strncmp(vars[i], name, n) == 0 && vars[i][n] == '=') return i;
+    }
+    return -1;
+}
+
+// Store assign, a malloc'd "NAME=value" whose name is n bytes, in place
+// of any earlier value
+static void put_var(char *assign, size_t n) {
+    int i = find_var(assign, n);
+    if (i >= 0) {
+        free(vars[i]);
+        vars[i] = assign;
+        return;
+    }
+    if (nvars + 2 > vars_cap) {
+        vars_cap = vars_cap ? vars_cap * 2 : 64;
+        vars = realloc(vars, vars_cap * sizeof(char *));
+        if (!vars) {
+            perror("environment allocation failed");
+            exit(1);
+        }
+    }
+    vars[nvars++] = assign;
+    vars[nvars] = NULL;
+}
+
+void init_env() {
+    vars_cap = 64;
+    vars = calloc(vars_cap, sizeof(char *));
+    if (!vars) {
+        perror("environment allocation failed");
+        exit(1);
+    }
+    for (char **e = environ; *e; e++) {
+        size_t n = name_length(*e);
+        if (n && (*e)[n] == '=') put_var(strdup(*e), n);
+    }
+}
+
+// The value of name, or NULL if it is unset
+const char *env_get(const char *name) {
+    size_t n = strlen(name);
+    int i = find_var(name, n);
+    return i >= 0 ? vars[i] + n + 1 : NULL;
+}
+
+void env_set(const char *name, const char *value) {
+    size_t n = strlen(name), len = strlen(value);
+    char *assign = malloc(n + len + 2);
+    if (!assign) {
+        perror("environment allocation failed");
+        exit(1);
+    }
+    memcpy(assign, name, n);
+    assign[n] = '=';
+    memcpy(assign + n + 1, value, len + 1);
+    put_var(assign, n);
+    if (strcmp(name, "PATH") == 0) load_path(value);
+}
+
+// Set a variable from assign, a "NAME=value" string
+void env_assign(const char *assign) {
+    size_t n = name_length(assign);
+    if (!n || assign[n] != '=') return;
+    char *copy = strdup(assign);
+    if (!copy) {
+        perror("environment allocation failed");
+        exit(1);
+    }
+    put_var(copy, n);
+    if (n == 4 && strncmp(assign, "PATH", 4) == 0) load_path(assign + 5);
+}
+
+void env_unset(const char *name) {
+    int i = find_var(name, strlen(name));
+    if (i < 0) return;
+    free(vars[i]);
+    memmove(&vars[i], &vars[i + 1], (nvars - i) * sizeof(char *));
+    nvars--;
+    if (strcmp(name, "PATH") == 0) load_path(NULL);
+}
+
+// The environment children are spawned with
+char **env_vector() {
+    return vars;
+}
+
+// Index of the last of the n assignments to the len-byte name, or -1
+static int find_assign(char **assigns, int n, const char *name, size_t len) {
+    for (int i = n - 1; i >= 0; i--) {
+        if (strncmp(assigns[i], name, len) == 0 && assigns[i][len] == '=') return i;
+    }
+    return -1;
+}
+
+// The value a command's "NAME=value" assignments give name, or NULL
+const char *assigned_value(char **assigns, int n, const char *name) {
+    size_t len = strlen(name);
+    int i = find_assign(assigns, n, name, len);
+    return i >= 0 ? assigns[i] + len + 1 : NULL;
+}
+
+// A malloc'd environment for a command with n "NAME=value" assignments:
+// the shell's, with the assigned variables replaced
+char **env_overlay(char **assigns, int n) {
+    char **envp = malloc((nvars + n + 1) * sizeof(char *));
+    if (!envp) {
+        perror("environment allocation failed");
+        exit(1);
+    }
+    int count = 0;
+    for (int i = 0; i < nvars; i++) {
+        if (find_assign(assigns, n, vars[i], name_length(vars[i])) < 0) envp[count++] = vars[i];
+    }
+    for (int i = 0; i < n; i++) {
+        size_t len = name_length(assigns[i]);
+        if (find_assign(assigns + i + 1, n - i - 1, assigns[i], len) < 0) {
+            envp[count++] = assigns[i];
+        }
+    }
+    envp[count] = NULL;
+    return envp;
+}
+
+// export [NAME[=value]]...: set variables; all of them are passed to
+// children. Without operands, list them in a form the shell reads back.
+int builtin_export(char **args, struct builtin_io *io) {
+    if (!args[1]) {
+        struct outbuf o = { .fd = io->out };
+        for (int i = 0; i < nvars; i++) {
+            size_t n = name_length(vars[i]);
+            out_str(&o, "export ");
+            out_write(&o, vars[i], n + 1);
+            out_str(&o, "'");
+            for (const char *v = vars[i] + n + 1; *v; v++) {
+                if (*v == '\'') out_str(&o, "'\\''");
+                else out_write(&o, v, 1);
+            }
+            out_str(&o, "'\n");
+        }
+        out_flush(&o);
+        return o.failed;
+    }
+
+    int status = 0;
+    for (int i = 1; args[i]; i++) {
+        size_t n = name_length(args[i]);
+        if (!n || (args[i][n] != '=' && args[i][n] != '\0')) {
+            dprintf(io->err, "export: '%s': not a valid identifier\n", args[i]);
+            status = 1;
+            continue;
+        }
+        if (args[i][n] == '=') env_assign(args[i]);
+    }
+    return status;
+}
+
+// unset NAME...: remove variables
+int builtin_unset(char **args, struct builtin_io *io) {
+    int status = 0;
+    for (int i = 1; args[i]; i++) {
+        size_t n = name_length(args[i]);
+        if (!n || args[i][n]) {
+            dprintf(io->err, "unset: '%s': not a valid identifier\n", args[i]);
+            status = 1;
+            continue;
+        }
+        env_unset(args[i]);
+    }
+    return status;
+}
@@ -0,0 +1,19 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include <stddef.h>
+#include "builtins.h"
+
+void init_env();
+const char *env_get(const char *name);
+void env_set(const char *name, const char *value);
+void env_assign(const char *assign);
+void env_unset(const char *name);
+char **env_vector();
+char **env_overlay(char **assigns, int n);
+const char *assigned_value(char **assigns, int n, const char *name);
+size_t name_length(const char *s);
+int builtin_export(char **args, struct builtin_io *io);
+int builtin_unset(char **args, struct builtin_io *io);
+
+#endif
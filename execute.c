@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,246 +6,721 @@
 #include <fcntl.h>
 #include <sys/wait.h>
 #include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/time.h>
 
 #include "execute.h"
 #include "builtins.h"
+#include "env.h"
+#include "expand.h"
+#include "fanout.h"
+#include "incremental.h"
 #include "path.h"
-
+#include "spawn.h"
+#include "stats.h"
+#include "jobs.h"
+#include "limit.h"
+#include "trace.h"
+#include "utils.h"
 
 extern int should_exit;
 
-char *trim_whitespace(char *str) {
-    while (*str == ' ' || *str == '\t') str++;
-    if (*str == 0) return str;
-    char *end = str + strlen(str) - 1;
-    while (end > str && (*end == '\n' || *end == ' ' || *end == '\t')) {
-        *end-- = '\0';
-    }
-    return str;
-}
+int last_status = 0;
+int errexit = 0;
 
-// === Command Execution ===
-void execute_command_direct(char *cmd) {
-    char *args[MAX_ARGS];
-    int argc = 0;
-    int redirect_in = 0, redirect_out = 0;
-    char *infile = NULL, *outfile = NULL;
+static struct parser line_parser;
+static const struct limits *pipeline_limits = &default_limits;    // of the pipeline being run
 
-    char *in_redir = strchr(cmd, '<');
-    char *out_redir = strchr(cmd, '>');
+static void close_redirects(struct spawn_io *io) {
+    if (io->in_fd >= 0) close(io->in_fd);
+    if (io->out_fd >= 0) close(io->out_fd);
+    if (io->err_fd >= 0) close(io->err_fd);
+}
 
-    if (in_redir) {
-        *in_redir = '\0';
-        infile = trim_whitespace(in_redir + 1);
-        redirect_in = 1;
+// The builtin cmd runs as, if any. A utility with an operands check defers
+// to the external command for arguments it does not handle, and when it
+// would be left reading the terminal (no file operands, not piped_in, no
+// '<' from a regular file), where only an external process can be
+// interrupted.
+static const struct builtin *find_stage_builtin(struct command *cmd, int piped_in) {
+    const struct builtin *b = find_builtin(cmd->argv[0]);
+    if (!b || !b->operands) return b;
+
+    int files = b->operands(cmd->argv);
+    if (files < 0) return NULL;
+    for (struct redir *r = cmd->redirs; r; r = r->next) {
+        if (r->type == REDIR_IN) piped_in = finite_file(r->target);
     }
+    return files || piped_in ? b : NULL;
+}
 
-    if (out_redir) {
-        *out_redir = '\0';
-        outfile = trim_whitespace(out_redir + 1);
-        redirect_out = 1;
+// The offsets at which the files a stage's '>'/'>>' redirections opened
+// started, so what a builtin writes through them can be counted; -1 for
+// a slot the shell did not open a file for, or that shares the other
+// slot's file.
+struct redirect_marks {
+    off_t out;
+    off_t err;
+};
+
+// Open redirection targets in the parent so failures are reported before
+// anything is launched. Descriptors are close-on-exec; unused ones are -1.
+// Redirections apply left to right, so the last one of an fd wins and
+// '2>&1' duplicates whatever stdout is at that point: an earlier '>'
+// target, or else out_default (the terminal or the stage's pipe).
+static int open_redirects(struct redir *r, struct spawn_io *io, int out_default,
+                          struct redirect_marks *marks) {
+    io->in_fd = -1;
+    io->out_fd = -1;
+    io->err_fd = -1;
+    marks->out = marks->err = -1;
+    io->cwd = NULL;
+    io->limits = child_limits(pipeline_limits);
+    io->envp = env_vector();
+
+    for (; r; r = r->next) {
+        int fd;
+        off_t start = -1;
+        if (r->type == REDIR_IN) {
+            fd = open(r->target, O_RDONLY | O_CLOEXEC);
+        } else if (r->type == REDIR_ERR_TO_OUT) {
+            fd = fcntl(io->out_fd >= 0 ? io->out_fd : out_default, F_DUPFD_CLOEXEC, 3);
+        } else if (r->type == REDIR_OUT_TO_ERR) {
+            fd = fcntl(io->err_fd >= 0 ? io->err_fd : STDERR_FILENO, F_DUPFD_CLOEXEC, 3);
+        } else {
+            int append = redir_appends(r->type);
+            int mode = append ? O_APPEND : O_TRUNC;
+            fd = open(r->target, O_WRONLY | O_CREAT | O_CLOEXEC | mode, 0644);
+            if (fd >= 0) start = append ? lseek(fd, 0, SEEK_END) : 0;
+        }
+        if (fd < 0) {
+            perror(r->type == REDIR_IN ? "input redirection failed" : "output redirection failed");
+            break;
+        }
+
+        int target_fd = redir_fd(r->type);
+        int *slot = target_fd == 0 ? &io->in_fd : target_fd == 2 ? &io->err_fd : &io->out_fd;
+        if (*slot >= 0) close(*slot);
+        *slot = fd;
+        if (slot == &io->out_fd) marks->out = start;
+        else if (slot == &io->err_fd) marks->err = start;
+
+        // '&>' is '>' followed by '2>&1'
+        if (r->type == REDIR_ALL || r->type == REDIR_ALL_APPEND) {
+            if (io->err_fd >= 0) close(io->err_fd);
+            io->err_fd = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+            marks->err = -1;
+            if (io->err_fd < 0) {
+                perror("output redirection failed");
+                break;
+            }
+        }
     }
+    if (!r) return 0;
 
-    cmd = trim_whitespace(cmd);
-    if (strlen(cmd) == 0) exit(0);
+    close_redirects(io);
+    io->in_fd = io->out_fd = io->err_fd = -1;
+    return -1;
+}
 
-    char *token = strtok(cmd, " \t\n");
-    while (token && argc < MAX_ARGS - 1) {
-        args[argc++] = token;
-        token = strtok(NULL, " \t\n");
+// Count what was written through the redirected files since they were
+// opened: the shared offsets also move for kernel-side copies
+static void count_redirected(int out_fd, int err_fd, const struct redirect_marks *marks) {
+    off_t end;
+    if (marks->out >= 0 && (end = lseek(out_fd, 0, SEEK_CUR)) > marks->out) {
+        stat_count(COUNT_REDIRECT_BYTES, end - marks->out);
     }
-    args[argc] = NULL;
+    if (marks->err >= 0 && (end = lseek(err_fd, 0, SEEK_CUR)) > marks->err) {
+        stat_count(COUNT_REDIRECT_BYTES, end - marks->err);
+    }
+}
 
-    if (argc == 0) exit(0);
+// === Command Execution ===
+// The executable cmd runs: from the lookup cache, or found on the PATH
+// the command assigns itself, in which case *owned is set to it for the
+// caller to free
+static char *command_path(struct command *cmd, char **owned) {
+    const char *path = assigned_value(cmd->assigns, cmd->nassigns, "PATH");
+    *owned = path ? search_dirs(cmd->argv[0], path) : NULL;
+    return path ? *owned : find_executable(cmd->argv[0]);
+}
 
-    if (handle_builtin(args)) exit(0);
+// Launch exec_path for cmd, whose assignments are added to the
+// environment of this child only
+static pid_t spawn_command(const char *exec_path, struct command *cmd, struct spawn_io *io,
+                           pid_t pgid) {
+    char **envp = cmd->nassigns ? env_overlay(cmd->assigns, cmd->nassigns) : NULL;
+    if (envp) io->envp = envp;
+    uint64_t t0 = stat_clock();
+    pid_t pid = spawn_process(exec_path, cmd->argv, io, pgid);
+    trace_span("spawn", t0, cmd->argv[0], strlen(cmd->argv[0]));
+    stat_time(STAT_SPAWN, t0);
+    free(envp);
+    return pid;
+}
 
-    if (redirect_in) {
-        int fd = open(infile, O_RDONLY);
-        if (fd < 0) {
-            perror("input redirection failed");
-            exit(1);
-        }
-        dup2(fd, STDIN_FILENO);
-        close(fd);
+// pl is the single-command pipeline cmd belongs to (for naming the job)
+int run_single_command(struct pipeline *pl) {
+    struct command *cmd = &pl->cmds[0];
+    struct spawn_io io;
+    struct redirect_marks marks;
+
+    // A bare redirection just creates/truncates its targets, and bare
+    // assignments set variables in the shell. As in sh, the status is that
+    // of the last substitution in them.
+    if (cmd->argc == 0) {
+        if (open_redirects(cmd->redirs, &io, STDOUT_FILENO, &marks) < 0) return 1;
+        close_redirects(&io);
+        for (int k = 0; k < cmd->nassigns; k++) env_assign(cmd->assigns[k]);
+        return subst_status >= 0 ? subst_status : 0;
     }
 
-    if (redirect_out) {
-        int fd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (fd < 0) {
-            perror("output redirection failed");
-            exit(1);
-        }
-        dup2(fd, STDOUT_FILENO);
-        close(fd);
+    // Builtins run in the shell, writing straight to the redirected fds
+    const struct builtin *b = find_stage_builtin(cmd, 0);
+    if (b) {
+        if (open_redirects(cmd->redirs, &io, STDOUT_FILENO, &marks) < 0) return 1;
+        struct builtin_io bio = {
+            io.in_fd >= 0 ? io.in_fd : STDIN_FILENO,
+            io.out_fd >= 0 ? io.out_fd : STDOUT_FILENO,
+            io.err_fd >= 0 ? io.err_fd : STDERR_FILENO
+        };
+        uint64_t t0 = stat_clock();
+        int status = b->fn(cmd->argv, &bio);
+        trace_span("builtin", t0, cmd->argv[0], strlen(cmd->argv[0]));
+        stat_time(STAT_BUILTIN, t0);
+        count_redirected(io.out_fd, io.err_fd, &marks);
+        close_redirects(&io);
+        return status;
     }
 
-    char *exec_path = find_executable(args[0]);
-    if (exec_path) {
-        execv(exec_path, args);
-        perror("execv failed");
-    } else {
-        fprintf(stderr, "command not found: %s\n", args[0]);
+    // Resolve in the parent so the lookup cache persists across commands
+    uint64_t t0 = trace_start();
+    char *owned;
+    char *exec_path = command_path(cmd, &owned);
+    trace_span("lookup", t0, cmd->argv[0], strlen(cmd->argv[0]));
+    if (!exec_path) {
+        fprintf(stderr, "command not found: %s\n", cmd->argv[0]);
+        return 127;
     }
-    exit(1);
-}
 
-void run_single_command(char *cmd) {
-    if (strlen(trim_whitespace(cmd)) == 0) return;
+    if (open_redirects(cmd->redirs, &io, STDOUT_FILENO, &marks) < 0) {
+        free(owned);
+        return 1;
+    }
+    pid_t pid = spawn_command(exec_path, cmd, &io, 0);
+    free(owned);
+    close_redirects(&io);
+    if (pid < 0) {
+        perror("spawn failed");
+        return 1;
+    }
 
-    // Parse arguments
-    char *args[MAX_ARGS];
-    int argc = 0;
-    char *infile = NULL, *outfile = NULL;
-    int redirect_in = 0, redirect_out = 0;
+    struct job *j = job_create(pl);
+    j->last_pid = pid;
+    job_add_process(j, pid, cmd->argv[0]);
+    job_set_timeout(j, pipeline_limits->timeout, pipeline_limits->kill_after);
+    return job_wait(j);
+}
 
-    char *in_redir = strchr(cmd, '<');
-    if (in_redir) {
-        *in_redir = '\0';
-        infile = trim_whitespace(in_redir + 1);
-        redirect_in = 1;
+// The copier of a fan-out with more than one branch: a thread of the
+// shell, or a process of the job when it runs in the background
+struct fanout_pump {
+    pthread_t tid;
+    int started;
+    int in;
+    int *outs;
+    int n;
+};
+
+// A pure builtin running as a pipeline stage inside the shell
+struct stage_thread {
+    pthread_t tid;
+    int started;
+    const struct builtin *b;
+    char **argv;
+    struct builtin_io io;
+    struct redirect_marks marks;
+    int status;
+};
+
+// Descriptors the shell holds for the pipeline being started: the pipe
+// ends of the fan-out pump, and those of builtin stage threads. Stages
+// forked as builtins never exec, so they would keep every one of them,
+// and a stage holding a write end of its own input pipe never sees EOF.
+// The forked child closes them all. stage_fds_lock makes a thread's
+// close and the fork exclusive, so the child's copy of the table matches
+// its descriptors exactly.
+static struct fanout_pump *pending_pump;
+static struct stage_thread *pending_threads;
+static int pending_count;
+static pthread_mutex_t stage_fds_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// In a forked stage: close them, and forget them
+static void close_stage_fds() {
+    if (pending_pump) {
+        if (pending_pump->in >= 0) close(pending_pump->in);
+        for (int b = 0; b < pending_pump->n; b++) close(pending_pump->outs[b]);
     }
-
-    char *out_redir = strchr(cmd, '>');
-    if (out_redir) {
-        *out_redir = '\0';
-        outfile = trim_whitespace(out_redir + 1);
-        redirect_out = 1;
+    for (int i = 0; i < pending_count; i++) {
+        struct stage_thread *th = &pending_threads[i];
+        if (!th->started) continue;
+        if (th->io.in > STDERR_FILENO) close(th->io.in);
+        if (th->io.out > STDERR_FILENO) close(th->io.out);
+        if (th->io.err > STDERR_FILENO) close(th->io.err);
     }
+    pending_pump = NULL;
+    pending_threads = NULL;
+    pending_count = 0;
+}
 
-    cmd = trim_whitespace(cmd);
-    if (strlen(cmd) == 0) return;
+static void *stage_main(void *arg) {
+    struct stage_thread *th = arg;
+    uint64_t t0 = stat_clock();
+    th->status = th->b->fn(th->argv, &th->io);
+    stat_time(STAT_BUILTIN, t0);
+    count_redirected(th->io.out, th->io.err, &th->marks);
+    // Closing our ends is what lets neighbouring stages see EOF/EPIPE
+    pthread_mutex_lock(&stage_fds_lock);
+    if (th->io.in > STDERR_FILENO) close(th->io.in);
+    if (th->io.out > STDERR_FILENO) close(th->io.out);
+    if (th->io.err > STDERR_FILENO) close(th->io.err);
+    th->io.in = th->io.out = th->io.err = -1;
+    pthread_mutex_unlock(&stage_fds_lock);
+    return NULL;
+}
 
-    char *token = strtok(cmd, " \t\n");
-    while (token && argc < MAX_ARGS - 1) {
-        args[argc++] = token;
-        token = strtok(NULL, " \t\n");
+// The thread owns its descriptors: redirections are handed over and pipe
+// ends, which the pipeline loop closes, are duplicated.
+static int start_thread(struct stage_thread *th, const struct builtin *b, char **argv,
+                        struct spawn_io *io, const struct redirect_marks *marks,
+                        int in_fd, int out_fd) {
+    th->b = b;
+    th->argv = argv;
+    th->marks = *marks;
+    th->io.in = io->in_fd >= 0 ? io->in_fd : STDIN_FILENO;
+    th->io.out = io->out_fd >= 0 ? io->out_fd : STDOUT_FILENO;
+    th->io.err = io->err_fd >= 0 ? io->err_fd : STDERR_FILENO;
+    if (io->in_fd >= 0 && io->in_fd == in_fd) th->io.in = fcntl(in_fd, F_DUPFD_CLOEXEC, 3);
+    if (io->out_fd >= 0 && io->out_fd == out_fd) th->io.out = fcntl(out_fd, F_DUPFD_CLOEXEC, 3);
+
+    if (th->io.in < 0 || th->io.out < 0 || pthread_create(&th->tid, NULL, stage_main, th) != 0) {
+        if (th->io.in > STDERR_FILENO) close(th->io.in);
+        if (th->io.out > STDERR_FILENO) close(th->io.out);
+        if (th->io.err > STDERR_FILENO) close(th->io.err);
+        perror("builtin stage failed");
+        return -1;
+    }
+    th->started = 1;
+    return 0;
+}
+
+// Start one pipeline stage reading from in_fd and writing to out_fd.
+// Pure builtins become threads in th (unless the stage is part of a
+// background job, which must outlive the line); other builtins fork so
+// their side effects stay out of the shell. Returns the child's pid, 0 if
+// no process was started, or -1 on failure.
+static pid_t start_stage(struct command *cmd, int in_fd, int out_fd, pid_t pgid,
+                         int background, struct stage_thread *th) {
+    struct spawn_io io;
+    struct redirect_marks marks;
+
+    int out_default = out_fd >= 0 ? out_fd : STDOUT_FILENO;
+    if (open_redirects(cmd->redirs, &io, out_default, &marks) < 0) return 0;
+    if (io.in_fd < 0) io.in_fd = in_fd;
+    if (io.out_fd < 0) io.out_fd = out_fd;
+
+    const struct builtin *b = cmd->argc > 0 ? find_stage_builtin(cmd, in_fd >= 0) : NULL;
+    pid_t pid;
+    if (cmd->argc == 0) {
+        pid = 0;
+    } else if (b && (b->flags & BI_PURE) && !background) {
+        if (start_thread(th, b, cmd->argv, &io, &marks, in_fd, out_fd) < 0) return -1;
+        return 0;
+    } else if (b) {
+        uint64_t t0 = stat_clock();
+        pthread_mutex_lock(&stage_fds_lock);
+        pid = fork_process(&io, pgid);
+        if (pid == 0) {
+            struct builtin_io bio = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+            close_stage_fds();
+            pthread_mutex_init(&stage_fds_lock, NULL);
+            int status = b->fn(cmd->argv, &bio);
+            count_redirected(STDOUT_FILENO, STDERR_FILENO, &marks);
+            exit(status);
+        }
+        pthread_mutex_unlock(&stage_fds_lock);
+        trace_span("spawn", t0, cmd->argv[0], strlen(cmd->argv[0]));
+        stat_time(STAT_SPAWN, t0);
+    } else {
+        uint64_t t0 = trace_start();
+        char *owned;
+        char *exec_path = command_path(cmd, &owned);
+        trace_span("lookup", t0, cmd->argv[0], strlen(cmd->argv[0]));
+        if (!exec_path) {
+            fprintf(stderr, "command not found: %s\n", cmd->argv[0]);
+            pid = 0;
+        } else {
+            pid = spawn_command(exec_path, cmd, &io, pgid);
+        }
+        free(owned);
     }
-    args[argc] = NULL;
 
-    if (argc == 0) return;
+    if (io.in_fd != in_fd) close(io.in_fd);
+    if (io.out_fd != out_fd) close(io.out_fd);
+    if (io.err_fd >= 0) close(io.err_fd);
+    if (pid < 0) perror("spawn failed");
+    return pid;
+}
 
-    // Handle built-in in parent
-    if (handle_builtin(args)) return;
+// The number of commands in pl, counting those of its branches
+static int pipeline_depth(const struct pipeline *pl) {
+    int n = pl->ncmds;
+    for (int b = 0; b < pl->nbranches; b++) n += pl->branches[b].ncmds;
+    return n;
+}
 
-    // Fork for external commands only
-    pid_t pid = fork();
-    if (pid < 0) {
-        perror("fork failed");
-        return;
-    }
-
-    if (pid == 0) {
-        // In child
-        signal(SIGINT, SIG_DFL);
-        signal(SIGTSTP, SIG_DFL);
-        setpgid(0, 0);
-
-        // Redirection
-        if (redirect_in) {
-            int fd = open(infile, O_RDONLY);
-            if (fd < 0) {
-                perror("input redirection failed");
-                exit(1);
+// Start cmds[0..n-1] as a chain reading from input_fd (-1 for stdin,
+// closed here) with the last stage writing to output_fd (-1 for stdout,
+// left open). Stages join j, and threads holds one slot per command.
+// Returns -1 if the chain could not be fully built.
+static int start_chain(struct command *cmds, int n, int input_fd, int output_fd, struct job *j,
+                       int background, struct stage_thread *threads) {
+    int pipes[2];
+    int aborted = 0;
+
+    for (int i = 0; i < n; i++) {
+        int stage_out = output_fd;
+        if (i < n - 1) {
+            if (pipe2(pipes, O_CLOEXEC) < 0) {
+                perror("pipe failed");
+                aborted = 1;
+                break;
             }
-            dup2(fd, STDIN_FILENO);
-            close(fd);
+            stage_out = pipes[1];
         }
-        if (redirect_out) {
-            int fd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (fd < 0) {
-                perror("output redirection failed");
-                exit(1);
+
+        pid_t pid = start_stage(&cmds[i], input_fd, stage_out, j->pgid, background, &threads[i]);
+        if (pid < 0) {
+            if (i < n - 1) {
+                close(pipes[0]);
+                close(pipes[1]);
             }
-            dup2(fd, STDOUT_FILENO);
-            close(fd);
+            aborted = 1;
+            break;
         }
-
-        char *exec_path = find_executable(args[0]);
-        if (exec_path) {
-            execv(exec_path, args);
-            perror("execv failed");
-        } else {
-            fprintf(stderr, "command not found: %s\n", args[0]);
+        if (pid > 0) job_add_process(j, pid, cmds[i].argv[0]);
+        if (i == n - 1) j->last_pid = pid;
+        if (threads[i].started) j->threads = 1;
+
+        if (input_fd >= 0) close(input_fd);
+        input_fd = -1;
+        if (i < n - 1) {
+            close(stage_out);
+            input_fd = pipes[0];
         }
-        exit(1);
-    } else {
-        int status;
-        waitpid(pid, &status, WUNTRACED);
-        if (WIFSTOPPED(status)) kill(pid, SIGKILL);
     }
+    if (input_fd >= 0) close(input_fd);
+    return aborted ? -1 : 0;
 }
 
-void run_piped_commands(char *line) {
-    char *commands[3];
-    int cmd_count = 0;
+static void *pump_main(void *arg) {
+    struct fanout_pump *f = arg;
+    fanout_copy(f->in, f->outs, f->n);
+    return NULL;
+}
 
-    char *token = strtok(line, "|");
-    while (token && cmd_count < 3) {
-        commands[cmd_count++] = trim_whitespace(token);
-        token = strtok(NULL, "|");
+// 'pl |> (b1) (b2) ...': each branch reads a copy of the output of pl's own
+// commands. A single branch just reads it through a pipe; otherwise the
+// pump copies it into a pipe per branch. Returns -1 if the fan-out could
+// not be fully built.
+static int start_fanout(struct pipeline *pl, int input_fd, struct job *j,
+                        struct stage_thread *threads, struct fanout_pump *pump) {
+    int pipes[2];
+    if (pipe2(pipes, O_CLOEXEC) < 0) {
+        perror("pipe failed");
+        if (input_fd >= 0) close(input_fd);
+        return -1;
+    }
+    pump->in = pipes[0];
+    pending_pump = pump;
+    int aborted = start_chain(pl->cmds, pl->ncmds, input_fd, pipes[1], j, pl->background,
+                              threads) < 0;
+    close(pipes[1]);
+    threads += pl->ncmds;
+
+    int k = pl->nbranches;
+    if (k == 1) {
+        pump->in = -1;
+        struct pipeline *br = &pl->branches[0];
+        if (aborted) {
+            close(pipes[0]);
+        } else {
+            aborted = start_chain(br->cmds, br->ncmds, pipes[0], -1, j, pl->background,
+                                  threads) < 0;
+        }
+        pending_pump = NULL;
+        return aborted ? -1 : 0;
     }
 
-    if (cmd_count == 0) return;
+    pump->outs = malloc(k * sizeof(int));
+    if (!pump->outs) {
+        perror("pipeline allocation failed");
+        aborted = 1;
+    }
+    for (int b = 0; b < k && !aborted; b++) {
+        if (pipe2(pipes, O_CLOEXEC) < 0) {
+            perror("pipe failed");
+            aborted = 1;
+            break;
+        }
+        pump->outs[pump->n++] = pipes[1];
+        struct pipeline *br = &pl->branches[b];
+        aborted = start_chain(br->cmds, br->ncmds, pipes[0], -1, j, pl->background, threads) < 0;
+        threads += br->ncmds;
+    }
+    pending_pump = NULL;
 
-    int input_fd = 0;
-    int pipes[2];
+    if (!aborted && pl->background) {
+        pid_t pid = fork_process(NULL, j->pgid);
+        if (pid == 0) {
+            signal(SIGPIPE, SIG_IGN);
+            fanout_copy(pump->in, pump->outs, pump->n);
+            _exit(0);
+        }
+        if (pid > 0) job_add_process(j, pid, "|>");
+        else perror("fork failed");
+        aborted = pid < 0;
+    } else if (!aborted) {
+        pump->started = pthread_create(&pump->tid, NULL, pump_main, pump) == 0;
+        if (!pump->started) perror("fan-out failed");
+        aborted = !pump->started;
+        j->threads = 1;
+    }
+    if (!pump->started) {
+        close(pump->in);
+        for (int b = 0; b < pump->n; b++) close(pump->outs[b]);
+    }
+    return aborted ? -1 : 0;
+}
 
+// Every stage is started before any is waited on, so data streams through
+// the whole chain at once. All stages share the first stage's process
+// group and form one job; the last stage's status is returned. A stage
+// that cannot be started is skipped: its neighbours see EOF/EPIPE. After
+// a fan-out, the status is that of the last branch's last stage.
+int run_piped_commands(struct pipeline *pl) {
+    int cmd_count = pipeline_depth(pl);
+    int input_fd = -1;
+    struct fanout_pump pump = { 0 };
+    struct job *j = job_create(pl);
+    struct stage_thread *threads = calloc(cmd_count, sizeof(*threads));
+    if (!threads) {
+        perror("pipeline allocation failed");
+        job_discard(j);
+        return 1;
+    }
+    j->status = 1;
+
+    // Without job control a background job must not read the terminal
+    if (pl->background && !job_control) input_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    pending_threads = threads;
+    pending_count = cmd_count;
+    int aborted;
+    if (pl->nbranches) aborted = start_fanout(pl, input_fd, j, threads, &pump) < 0;
+    else aborted = start_chain(pl->cmds, pl->ncmds, input_fd, -1, j, pl->background, threads) < 0;
+    pending_threads = NULL;
+    pending_count = 0;
+
+    // A pipeline that could not be fully built cannot make progress
+    if (aborted && j->nprocs > 0) kill(-j->pgid, SIGKILL);
+
+    job_set_timeout(j, pipeline_limits->timeout, pipeline_limits->kill_after);
+    if (pl->background && !aborted && j->nprocs > 0) {
+        free(pump.outs);
+        free(threads);
+        job_background(j);
+        return 0;
+    }
+
+    int last_status = job_wait(j);
     for (int i = 0; i < cmd_count; i++) {
-        if (i < cmd_count - 1 && pipe(pipes) < 0) {
-            perror("pipe failed");
-            return;
+        if (!threads[i].started) continue;
+        pthread_join(threads[i].tid, NULL);
+        // A builtin last stage leaves the job's own status at 1 unless
+        // the job timed out
+        if (i == cmd_count - 1 && !aborted && last_status != STATUS_TIMEOUT) {
+            last_status = threads[i].status;
         }
+    }
+    if (pump.started) pthread_join(pump.tid, NULL);
+    free(pump.outs);
+    free(threads);
 
-        pid_t pid = fork();
-        if (pid < 0) {
-            perror("fork failed");
-            return;
+    return aborted ? 1 : last_status;
+}
+
+// A copy of pl in a without the 'limit' prefix, whose options are read
+// into l. Returns pl itself if there is no prefix, or NULL after a usage
+// error.
+static struct pipeline *strip_limit(struct arena *a, struct pipeline *pl, struct limits *l) {
+    struct command *first = &pl->cmds[0];
+    if (first->argc == 0 || strcmp(first->argv[0], "limit") != 0) return pl;
+    int k = limit_command(first->argv, l, STDERR_FILENO);
+    if (k <= 0) return k < 0 ? NULL : pl;
+
+    struct pipeline *copy = arena_alloc(a, sizeof(*copy));
+    *copy = *pl;
+    copy->cmds = arena_alloc(a, pl->ncmds * sizeof(struct command));
+    memcpy(copy->cmds, pl->cmds, pl->ncmds * sizeof(struct command));
+    copy->cmds[0].argv += k;
+    copy->cmds[0].argc -= k;
+    return copy;
+}
+
+// Substitutions in the pipeline's words run first, all before any stage
+// starts; the expanded copy lives until the pipeline has been reported.
+// A 'limit' prefix is then applied, and in incremental mode an up-to-date
+// pipeline is skipped.
+static int run_pipeline(struct pipeline *pl) {
+    struct arena expanded = { 0 };
+    subst_status = -1;
+    if (pipeline_expands(pl)) {
+        pl = expand_pipeline(&expanded, pl);
+        if (!pl) {
+            arena_free(&expanded);
+            return 1;
         }
+    }
 
-        if (pid == 0) {
-            signal(SIGINT, SIG_DFL);
-            signal(SIGTSTP, SIG_DFL);
-            setpgid(0, 0);
+    struct limits limits = default_limits;
+    pl = strip_limit(&expanded, pl, &limits);
+    if (!pl) {
+        arena_free(&expanded);
+        return 2;
+    }
+    const struct limits *saved = pipeline_limits;
+    pipeline_limits = &limits;
+
+    struct fingerprint fp;
+    int state = -1;
+    if (incremental || pl->cached) state = fingerprint_up_to_date(pl, &fp);
+
+    int status = 0;
+    if (state != 1) {
+        stat_value(STAT_DEPTH, pipeline_depth(pl));
+        if (pl->ncmds == 1 && !pl->background && !pl->nbranches) status = run_single_command(pl);
+        else status = run_piped_commands(pl);
+        if (state == 0 && status == 0) fingerprint_record(pl, &fp);
+    }
+    pipeline_limits = saved;
+    arena_free(&expanded);
+    return status;
+}
 
-            if (input_fd != 0) {
-                dup2(input_fd, STDIN_FILENO);
-                close(input_fd);
-            }
-            if (i < cmd_count - 1) {
-                dup2(pipes[1], STDOUT_FILENO);
-                close(pipes[0]);
-                close(pipes[1]);
-            }
-            execute_command_direct(commands[i]);
-        } else {
-            if (input_fd != 0) close(input_fd);
-            if (i < cmd_count - 1) {
-                close(pipes[1]);
-                input_fd = pipes[0];
-            }
-            waitpid(pid, NULL, 0);
+static double seconds(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// 'time pipeline': real time, CPU time of the shell and the pipeline's
+// processes (from their wait status), and the largest child's peak RSS
+static int run_timed(struct pipeline *pl) {
+    struct timespec start, end;
+    struct rusage self_start, self_end;
+    struct rusage jobs_start = job_rusage;
+
+    job_rusage.ru_maxrss = 0;
+    getrusage(RUSAGE_SELF, &self_start);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int status = run_pipeline(pl);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_SELF, &self_end);
+    long maxrss = job_rusage.ru_maxrss;
+    if (jobs_start.ru_maxrss > job_rusage.ru_maxrss) job_rusage.ru_maxrss = jobs_start.ru_maxrss;
+
+    double real = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    double user = seconds(self_end.ru_utime) - seconds(self_start.ru_utime) +
+                  seconds(job_rusage.ru_utime) - seconds(jobs_start.ru_utime);
+    double sys = seconds(self_end.ru_stime) - seconds(self_start.ru_stime) +
+                 seconds(job_rusage.ru_stime) - seconds(jobs_start.ru_stime);
+    fprintf(stderr, "\nreal\t%dm%.3fs\nuser\t%dm%.3fs\nsys\t%dm%.3fs\nmaxrss\t%ldk\n",
+            (int)(real / 60), real - 60 * (int)(real / 60),
+            (int)(user / 60), user - 60 * (int)(user / 60),
+            (int)(sys / 60), sys - 60 * (int)(sys / 60), maxrss);
+    return status;
+}
+
+static int commands_have_side_effects(const struct pipeline *pl) {
+    for (int j = 0; j < pl->ncmds; j++) {
+        const struct command *cmd = &pl->cmds[j];
+        if (cmd->argc == 0 && cmd->nassigns) return 1;
+        if (cmd->argc == 0) continue;
+        char **argv = cmd->argv;
+        if (j == 0 && strcmp(argv[0], "limit") == 0) {
+            struct limits scratch;
+            int k = limit_command(argv, &scratch, -1);
+            if (k > 0) argv += k;
+        }
+        if (cmd->expand && (strchr(argv[0], SUBST_BEGIN) || strchr(argv[0], SUBST_QUOTED))) {
+            return 1;
         }
+        const struct builtin *b = find_builtin(argv[0]);
+        if (b && !(b->flags & BI_PURE)) return 1;
     }
+    for (int b = 0; b < pl->nbranches; b++) {
+        if (commands_have_side_effects(&pl->branches[b])) return 1;
+    }
+    return 0;
 }
 
-void parse_and_execute(char *line) {
-    char *command = strtok(line, ";");
-    while (command) {
-        command = trim_whitespace(command);
-        if (strlen(command) == 0) {
-            command = strtok(NULL, ";");
+// Whether running seq in the shell could change shell state: it starts a
+// background job, runs a builtin other than a pure one as a command of its
+// own, sets variables, or computes a command name with a substitution. A
+// 'limit' prefix is judged by the command it limits.
+int sequence_has_side_effects(const struct sequence *seq) {
+    for (int i = 0; i < seq->npipes; i++) {
+        const struct pipeline *pl = &seq->pipes[i];
+        if (pl->background || commands_have_side_effects(pl)) return 1;
+    }
+    return 0;
+}
+
+// Runs each pipeline unless '&&' or '||' skips it on the status of the
+// one before. With set -e, a failure that no '&&' or '||' tests ends the
+// shell. Returns the exit status of the last pipeline run.
+int run_sequence(struct sequence *seq) {
+    for (int i = 0; i < seq->npipes && !should_exit; i++) {
+        struct pipeline *pl = &seq->pipes[i];
+        if ((pl->run_if == RUN_IF_OK && last_status != 0) ||
+            (pl->run_if == RUN_IF_FAILED && last_status == 0)) {
             continue;
         }
 
-        if (strchr(command, '|')) {
-            run_piped_commands(command);
-        } else {
-            run_single_command(command);
-        }
+        if (pl->timed && !pl->background) last_status = run_timed(pl);
+        else last_status = run_pipeline(pl);
 
-        if (should_exit) break;
+        if (errexit && last_status != 0 &&
+            (i + 1 == seq->npipes || seq->pipes[i + 1].run_if == RUN_ALWAYS)) {
+            should_exit = 1;
+        }
+    }
+    return last_status;
+}
 
-        command = strtok(NULL, ";");
+int parse_and_execute(const char *line, size_t len) {
+    uint64_t t0 = stat_clock();
+    struct sequence *seq = parse_line(&line_parser, line, len);
+    trace_span("parse", t0, line, len);
+    stat_time(STAT_PARSE, t0);
+    if (!seq) {
+        fprintf(stderr, "syntax error: %s\n", line_parser.error);
+        last_status = 2;
+        if (errexit) should_exit = 1;
+        return 2;
     }
+    return run_sequence(seq);
 }
@@ -1,9 +1,15 @@
 #ifndef EXECUTE_H
 #define EXECUTE_H
 
-void run_single_command(char *cmd);
-void run_piped_commands(char *line);
-void parse_and_execute(char *line);
-char *trim_whitespace(char *str);
+#include "parse.h"
+
+extern int last_status;     // $?
+extern int errexit;         // set -e
+
+int run_single_command(struct pipeline *pl);
+int run_piped_commands(struct pipeline *pl);
+int run_sequence(struct sequence *seq);
+int sequence_has_side_effects(const struct sequence *seq);
+int parse_and_execute(const char *line, size_t len);
 
 #endif
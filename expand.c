@@ -0,0 +1,379 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include "expand.h"
+#include "env.h"
+#include "execute.h"
+#include "jobs.h"
+#include "stats.h"
+#include "trace.h"
+#include "wildcard.h"
+
+// === Command Substitution ===
+// The command text runs with its stdout on a pipe that is read into a
+// growable buffer; nothing touches the disk. A command list that cannot
+// change shell state runs in the shell itself with fd 1 pointed at the
+// pipe, so pure builtins run without forking and external commands are
+// spawned as usual while a reader thread drains the pipe. A list that
+// could (cd, exit, path, background jobs, ...) runs in a forked subshell.
+struct capture {
+    int fd;
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+static int depth;
+int subst_status = -1;
+
+static void put_byte(struct capture *c, char ch) {
+    if (c->len == c->cap) {
+        c->cap = c->cap ? c->cap * 2 : 256;
+        c->data = realloc(c->data, c->cap);
+        if (!c->data) {
+            perror("expansion allocation failed");
+            exit(1);
+        }
+    }
+    c->data[c->len++] = ch;
+}
+
+static void read_all(struct capture *c) {
+    for (;;) {
+        if (c->cap - c->len < 4096) {
+            c->cap = c->cap ? c->cap * 2 : 4096;
+            c->data = realloc(c->data, c->cap);
+            if (!c->data) {
+                perror("expansion allocation failed");
+                exit(1);
+            }
+        }
+        ssize_t n = read(c->fd, c->data + c->len, c->cap - c->len);
+        if (n > 0) c->len += n;
+        else if (n == 0 || errno != EINTR) break;
+    }
+}
+
+static void *reader_main(void *arg) {
+    read_all(arg);
+    return NULL;
+}
+
+// Run text and append its stdout to c. Returns the command's status, or
+// -1 if it could not be run.
+static int capture_output(const char *text, size_t len, struct capture *c) {
+    if (depth >= SUBST_MAX_DEPTH) {
+        fprintf(stderr, "command substitution nested too deeply\n");
+        return -1;
+    }
+
+    struct parser parser = { 0 };
+    uint64_t t0 = stat_clock();
+    struct sequence *seq = parse_line(&parser, text, len);
+    trace_span("parse", t0, text, len);
+    stat_time(STAT_PARSE, t0);
+    if (!seq) {
+        fprintf(stderr, "syntax error: %s\n", parser.error);
+        parser_free(&parser);
+        return -1;
+    }
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        perror("pipe failed");
+        parser_free(&parser);
+        return -1;
+    }
+    c->fd = fds[0];
+
+    int status;
+    fflush(stdout);
+    if (!sequence_has_side_effects(seq)) {
+        pthread_t reader;
+        int saved = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3);
+        if (saved < 0 || (errno = pthread_create(&reader, NULL, reader_main, c)) != 0) {
+            perror("command substitution failed");
+            if (saved >= 0) close(saved);
+            close(fds[0]);
+            close(fds[1]);
+            parser_free(&parser);
+            return -1;
+        }
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[1]);
+
+        depth++;
+        status = run_sequence(seq);
+        depth--;
+
+        fflush(stdout);
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+        pthread_join(reader, NULL);
+    } else {
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid == 0) {
+            reset_jobs_after_fork();
+            dup2(fds[1], STDOUT_FILENO);
+            depth++;
+            status = run_sequence(seq);
+            fflush(stdout);
+            trace_flush();
+            _exit(status);
+        }
+        close(fds[1]);
+        if (pid < 0) {
+            perror("fork failed");
+            close(fds[0]);
+            parser_free(&parser);
+            return -1;
+        }
+        read_all(c);
+        int ws;
+        while (waitpid(pid, &ws, 0) < 0 && errno == EINTR) {}
+        status = WIFEXITED(ws) ? WEXITSTATUS(ws) : 128 + WTERMSIG(ws);
+        last_status = status;
+    }
+    dir_cache_clear();
+
+    close(fds[0]);
+    parser_free(&parser);
+    return status;
+}
+
+// === Word Expansion ===
+// Each field is built twice: as text, and as a glob pattern in which
+// every byte that came from quotes (or quoted expansions) is escaped. A
+// field whose pattern has an active '*', '?' or bracket expression is
+// replaced by the paths it matches, or kept as text if there are none.
+struct fields {
+    struct arena *a;
+    char **v;
+    int n;
+    int cap;
+    struct capture buf;     // the field being built
+    struct capture pat;     // ... as a pattern
+    int open;               // buf holds a field, possibly empty
+    int glob;               // the word's fields are matched as globs
+};
+
+static void add_field(struct fields *f, char *s) {
+    if (f->n == f->cap) {
+        f->cap = f->cap ? f->cap * 2 : 16;
+        f->v = realloc(f->v, f->cap * sizeof(char *));
+        if (!f->v) {
+            perror("expansion allocation failed");
+            exit(1);
+        }
+    }
+    f->v[f->n++] = s;
+}
+
+static void end_field(struct fields *f) {
+    size_t n = 0;
+    if (f->glob && word_has_glob(f->pat.data, f->pat.len)) {
+        char **paths = glob_paths(f->a, f->pat.data, f->pat.len, &n);
+        for (size_t i = 0; i < n; i++) add_field(f, paths[i]);
+        free(paths);
+    }
+    if (n == 0) add_field(f, arena_strndup(f->a, f->buf.data ? f->buf.data : "", f->buf.len));
+    f->buf.len = 0;
+    f->pat.len = 0;
+    f->open = 0;
+}
+
+// Add c to the field; unless active it is literal in the pattern
+static void add_byte(struct fields *f, char c, int active) {
+    put_byte(&f->buf, c);
+    int special = c == '*' || c == '?' || c == '[' || c == ']' ||
+                  (c >= SUBST_BEGIN && c <= WORD_ESCAPE);
+    if (!active && special) {
+        put_byte(&f->pat, WORD_ESCAPE);
+    }
+    put_byte(&f->pat, c);
+    f->open = 1;
+}
+
+static int is_ifs(char c) {
+    return c == ' ' || c == '\t' || c == '\n';
+}
+
+// Value of parameter name into out; an unset variable is empty
+static void param_value(const char *name, struct capture *out) {
+    char buf[16];
+    const char *v = buf;
+    if (strcmp(name, "?") == 0) snprintf(buf, sizeof(buf), "%d", last_status);
+    else if (!(v = env_get(name))) return;
+    for (; *v; v++) put_byte(out, *v);
+}
+
+// Expand w into fields. Substitution output loses its trailing newlines.
+// Unquoted results are split on blanks and newlines, and fields matched
+// as globs, unless split is 0.
+static int expand_word(struct fields *f, const char *w, int split) {
+    struct capture out = { 0 };
+    struct capture text = { 0 };
+    int plain = 1;
+    f->glob = split;
+
+    while (*w) {
+        char c = *w++;
+        if (c == WORD_ESCAPE) {
+            if (*w) add_byte(f, *w++, 0);
+            continue;
+        }
+        if (c != SUBST_BEGIN && c != SUBST_QUOTED && c != PARAM_BEGIN && c != PARAM_QUOTED) {
+            add_byte(f, c, 1);
+            continue;
+        }
+
+        // The command text or parameter name, with its escapes removed
+        text.len = 0;
+        while (*w && *w != EXPAND_END) {
+            if (*w == WORD_ESCAPE && w[1]) w++;
+            put_byte(&text, *w++);
+        }
+        put_byte(&text, '\0');
+        if (*w) w++;
+        plain = 0;
+
+        out.len = 0;
+        if (c == PARAM_BEGIN || c == PARAM_QUOTED) {
+            param_value(text.data, &out);
+        } else {
+            if ((subst_status = capture_output(text.data, text.len - 1, &out)) < 0) {
+                free(text.data);
+                free(out.data);
+                return -1;
+            }
+            while (out.len > 0 && out.data[out.len - 1] == '\n') out.len--;
+        }
+
+        int quoted = c == SUBST_QUOTED || c == PARAM_QUOTED;
+        for (size_t i = 0; i < out.len; i++) {
+            if (out.data[i] == '\0') continue;
+            if (split && !quoted && is_ifs(out.data[i])) {
+                if (f->open) end_field(f);
+            } else {
+                add_byte(f, out.data[i], !quoted);
+            }
+        }
+        if (quoted) f->open = 1;
+    }
+
+    // A word that was only unquoted expansions may expand to nothing
+    if (f->open || plain || !split) end_field(f);
+    free(text.data);
+    free(out.data);
+    return 0;
+}
+
+// Whether w has a $? expansion
+static int reads_status(const char *w) {
+    for (; *w; w++) {
+        if ((*w == PARAM_BEGIN || *w == PARAM_QUOTED) && w[1] == '?') return 1;
+    }
+    return 0;
+}
+
+static int pipeline_uses_status(const struct pipeline *pl) {
+    for (int j = 0; j < pl->ncmds; j++) {
+        const struct command *cmd = &pl->cmds[j];
+        if (!cmd->expand) continue;
+        for (int k = 0; k < cmd->argc; k++) {
+            if (reads_status(cmd->argv[k])) return 1;
+        }
+        for (int k = 0; k < cmd->nassigns; k++) {
+            if (reads_status(cmd->assigns[k])) return 1;
+        }
+        for (struct redir *r = cmd->redirs; r; r = r->next) {
+            if (reads_status(r->target)) return 1;
+        }
+    }
+    for (int b = 0; b < pl->nbranches; b++) {
+        if (pipeline_uses_status(&pl->branches[b])) return 1;
+    }
+    return 0;
+}
+
+// Whether any word in seq reads $?, whose value depends on the lines run
+// before it
+int sequence_uses_status(const struct sequence *seq) {
+    for (int i = 0; i < seq->npipes; i++) {
+        if (pipeline_uses_status(&seq->pipes[i])) return 1;
+    }
+    return 0;
+}
+
+// Expand the commands of copy, a shallow copy of pl, and of its branches.
+// Returns -1 if a substitution could not be run.
+static int expand_commands(struct arena *a, struct fields *f, struct pipeline *copy,
+                           const struct pipeline *pl) {
+    copy->cmds = arena_alloc(a, pl->ncmds * sizeof(struct command));
+    memcpy(copy->cmds, pl->cmds, pl->ncmds * sizeof(struct command));
+
+    int failed = 0;
+    for (int i = 0; i < pl->ncmds && !failed; i++) {
+        const struct command *src = &pl->cmds[i];
+        struct command *cmd = &copy->cmds[i];
+        if (!src->expand) continue;
+        cmd->expand = 0;
+
+        f->n = 0;
+        for (int k = 0; k < src->argc && !failed; k++) failed = expand_word(f, src->argv[k], 1) < 0;
+        cmd->argc = f->n;
+        cmd->argv = arena_alloc(a, (f->n + 1) * sizeof(char *));
+        memcpy(cmd->argv, f->v, f->n * sizeof(char *));
+        cmd->argv[f->n] = NULL;
+
+        cmd->assigns = arena_alloc(a, src->nassigns * sizeof(char *));
+        for (int k = 0; k < src->nassigns && !failed; k++) {
+            f->n = 0;
+            failed = expand_word(f, src->assigns[k], 0) < 0;
+            if (!failed) cmd->assigns[k] = f->v[0];
+        }
+        struct redir **tail = &cmd->redirs;
+        for (struct redir *sr = src->redirs; sr && !failed; sr = sr->next) {
+            f->n = 0;
+            failed = expand_word(f, sr->target, 0) < 0;
+            if (failed) break;
+            struct redir *r = arena_alloc(a, sizeof(*r));
+            r->type = sr->type;
+            r->target = f->v[0];
+            *tail = r;
+            tail = &r->next;
+        }
+        *tail = NULL;
+    }
+
+    copy->branches = arena_alloc(a, pl->nbranches * sizeof(struct pipeline));
+    for (int b = 0; b < pl->nbranches && !failed; b++) {
+        copy->branches[b] = pl->branches[b];
+        failed = expand_commands(a, f, &copy->branches[b], &pl->branches[b]) < 0;
+    }
+    return failed ? -1 : 0;
+}
+
+// Copy pl with every word of its expanding commands expanded, in order,
+// into a. Returns NULL if a substitution could not be run.
+struct pipeline *expand_pipeline(struct arena *a, const struct pipeline *pl) {
+    dir_cache_clear();
+    struct pipeline *copy = arena_alloc(a, sizeof(*copy));
+    *copy = *pl;
+
+    struct fields f = { .a = a };
+    int failed = expand_commands(a, &f, copy, pl) < 0;
+
+    free(f.v);
+    free(f.buf.data);
+    free(f.pat.data);
+    return failed ? NULL : copy;
+}
@@ -0,0 +1,17 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include "arena.h"
+#include "parse.h"
+
+// Substitutions nested deeper than this fail instead of recursing
+#define SUBST_MAX_DEPTH 32
+
+// Status of the last command substitution run, for a command with no
+// name; run_pipeline sets it to -1 first
+extern int subst_status;
+
+struct pipeline *expand_pipeline(struct arena *a, const struct pipeline *pl);
+int sequence_uses_status(const struct sequence *seq);
+
+#endif
@@ -0,0 +1,150 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "fanout.h"
+
+// === Fan-out ===
+// 'producer |> (c1) (c2) ... (ck)' copies the producer's output into a
+// pipe per consumer without it passing through user space. tee() copies
+// the bytes in a pipe into another without consuming them, so the copy
+// runs as a chain of k-1 stages: stage i tees its input into consumer i's
+// pipe, then splices the same bytes on to the next stage's input (the
+// last stage's goes to consumer k). A full consumer pipe stalls the whole
+// chain, so the producer runs at the pace of the slowest consumer. A
+// consumer that exits is dropped (EPIPE) and the others keep reading; once
+// all have exited the producer's pipe is closed and it gets EPIPE too.
+struct fan_stage {
+    int in;             // -1 once the stage is done
+    int copy;           // consumer pipe, -1 once that consumer is gone
+    int out;            // the next stage's input or the last consumer, likewise
+    size_t pending;     // teed into copy but still at the front of in
+    int wait_fd;        // what a blocked stage waits for
+    short wait_events;
+};
+
+static void close_fd(int *fd) {
+    if (*fd >= 0) close(*fd);
+    *fd = -1;
+}
+
+static int finish(struct fan_stage *s) {
+    close_fd(&s->in);
+    close_fd(&s->copy);
+    close_fd(&s->out);
+    return -1;
+}
+
+// After EAGAIN moving bytes from in to fd: wait for in to fill if it is
+// empty, otherwise for fd to drain
+static int blocked(struct fan_stage *s, int fd) {
+    int avail = 0;
+    ioctl(s->in, FIONREAD, &avail);
+    s->wait_fd = avail > 0 ? fd : s->in;
+    s->wait_events = avail > 0 ? POLLOUT : POLLIN;
+    return 0;
+}
+
+// Drop the pending bytes, whose reader has gone; they are in the pipe
+// already, so this never blocks
+static void discard(struct fan_stage *s) {
+    char buf[16384];
+    while (s->pending > 0) {
+        ssize_t n = read(s->in, buf, s->pending < sizeof(buf) ? s->pending : sizeof(buf));
+        if (n <= 0) break;
+        s->pending -= n;
+    }
+    s->pending = 0;
+}
+
+// Move what can be moved without blocking. Returns 1 after progress, 0
+// if blocked (on wait_fd), or -1 once the stage is done.
+static int step(struct fan_stage *s) {
+    if (s->in < 0) return -1;
+    int *to = s->pending > 0 || s->copy < 0 ? &s->out : &s->copy;
+    if (*to < 0) {
+        if (s->pending > 0) {
+            discard(s);
+            return 1;
+        }
+        return finish(s);
+    }
+
+    ssize_t n;
+    if (s->pending > 0) {
+        n = splice(s->in, NULL, s->out, NULL, s->pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) s->pending -= n;
+    } else if (s->out >= 0 && s->copy >= 0) {
+        n = tee(s->in, s->copy, FANOUT_CHUNK, SPLICE_F_NONBLOCK);
+        if (n > 0) s->pending = n;
+    } else {
+        n = splice(s->in, NULL, *to, NULL, FANOUT_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    }
+
+    if (n > 0) return 1;
+    if (n == 0) return finish(s);
+    if (errno == EAGAIN) return blocked(s, *to);
+    if (errno == EINTR) return 1;
+    if (errno == EPIPE) {
+        close_fd(to);
+        return 1;
+    }
+    perror("fan-out failed");
+    return finish(s);
+}
+
+// Copy everything read from in into each of the n (at least 2) pipes in
+// outs until in reaches EOF or every reader has gone. Closes in and outs.
+void fanout_copy(int in, const int *outs, int n) {
+    struct fan_stage *st = calloc(n - 1, sizeof(*st));
+    struct pollfd *fds = calloc(n - 1, sizeof(*fds));
+    int i = 0;
+    if (!st || !fds) {
+        perror("fan-out allocation failed");
+    } else {
+        for (; i < n - 1; i++) {
+            int pipes[2] = { -1, outs[n - 1] };
+            if (i < n - 2 && pipe2(pipes, O_CLOEXEC) < 0) {
+                perror("pipe failed");
+                break;
+            }
+            st[i] = (struct fan_stage){ .in = in, .copy = outs[i], .out = pipes[1] };
+            in = pipes[0];
+        }
+    }
+
+    // A chain that could not be built copies nothing
+    if (i < n - 1) {
+        for (int k = 0; k < i; k++) finish(&st[k]);
+        close(in);
+        for (int k = i; k < n; k++) close(outs[k]);
+        free(st);
+        free(fds);
+        return;
+    }
+
+    int live = n - 1;
+    while (live) {
+        int progress = 0, nfds = 0;
+        live = 0;
+        for (int i = 0; i < n - 1; i++) {
+            int r = step(&st[i]);
+            if (r < 0) continue;
+            live++;
+            if (r > 0) progress = 1;
+            else fds[nfds++] = (struct pollfd){ st[i].wait_fd, st[i].wait_events, 0 };
+        }
+        if (live && !progress && poll(fds, nfds, -1) < 0 && errno != EINTR) {
+            perror("fan-out poll failed");
+            for (int i = 0; i < n - 1; i++) finish(&st[i]);
+            break;
+        }
+    }
+    free(st);
+    free(fds);
+}
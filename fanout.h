@@ -0,0 +1,9 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+
+// Most bytes one tee() or splice() call is asked to move
+#define FANOUT_CHUNK (1 << 20)
+
+void fanout_copy(int in, const int *outs, int n);
+
+#endif
@@ -0,0 +1,657 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "filters.h"
+#include "utils.h"
+
+// === Line Filters ===
+// head, wc -l/-c, grep -F and tee as in-process utilities, so the usual
+// tail of a pipeline is a thread reading the upstream pipe instead of a
+// fork+exec and another pipe copy. Output matches GNU coreutils and grep
+// byte for byte; anything they implement that these do not (other
+// options, regexes, multibyte locales) is left to the external command
+// by the operands checks.
+#define FILTER_BUFSIZE (128 * 1024)
+
+// --- Scanning ---
+// SSE2 is part of x86-64, so these need no runtime dispatch; elsewhere the
+// scalar loops and glibc's memchr/memmem do the work.
+
+// Number of c bytes in p[0..n)
+static size_t count_byte(const char *p, size_t n, char c) {
+    size_t count = 0, i = 0;
+#ifdef __SSE2__
+    const __m128i needle = _mm_set1_epi8(c);
+    while (n - i >= 16) {
+        // Per-byte counters, folded into the total before they can wrap
+        size_t blocks = (n - i) / 16;
+        if (blocks > 255) blocks = 255;
+        __m128i acc = _mm_setzero_si128();
+        for (size_t b = 0; b < blocks; b++, i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(v, needle));
+        }
+        __m128i sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+        count += _mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4);
+    }
+#endif
+    for (; i < n; i++) count += p[i] == c;
+    return count;
+}
+
+// Just past the *k-th newline in p[0..n), or NULL with *k reduced by the
+// newlines seen. *k must be positive.
+static const char *skip_lines(const char *p, size_t n, uint64_t *k) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i nl = _mm_set1_epi8('\n');
+    for (; n - i >= 16; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+        unsigned c = __builtin_popcount(mask);
+        if (c < *k) {
+            *k -= c;
+            continue;
+        }
+        while (--*k) mask &= mask - 1;
+        return p + i + __builtin_ctz(mask) + 1;
+    }
+#endif
+    for (; i < n; i++) {
+        if (p[i] == '\n' && --*k == 0) return p + i + 1;
+    }
+    return NULL;
+}
+
+// First occurrence of s[0..m) in h[0..n). Candidates are positions whose
+// first and last bytes both match, found 16 at a time.
+static const char *find_literal(const char *h, size_t n, const char *s, size_t m) {
+    if (m == 0) return h;
+    if (m > n) return NULL;
+    if (m == 1) return memchr(h, s[0], n);
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i first = _mm_set1_epi8(s[0]);
+    const __m128i last = _mm_set1_epi8(s[m - 1]);
+    for (; i + m - 1 + 16 <= n; i += 16) {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(h + i)), first);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(h + i + m - 1)), last);
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(a, b));
+        for (; mask; mask &= mask - 1) {
+            unsigned bit = __builtin_ctz(mask);
+            if (memcmp(h + i + bit + 1, s + 1, m - 2) == 0) return h + i + bit;
+        }
+    }
+#endif
+    return memmem(h + i, n - i, s, m);
+}
+
+// --- Output ---
+// Selected lines are written straight from the input buffer, gathered
+// into one writev() per batch; adjacent lines merge into one entry.
+#define SINK_IOV 64
+
+struct sink {
+    int fd;
+    int failed;     // errno of the failed write, or 0
+    int n;
+    struct iovec iov[SINK_IOV];
+};
+
+static void sink_flush(struct sink *s) {
+    struct iovec *v = s->iov;
+    int n = s->n;
+    while (n > 0 && !s->failed) {
+        ssize_t w = writev(s->fd, v, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0) {
+            s->failed = errno;
+            break;
+        }
+        for (; n > 0 && (size_t)w >= v->iov_len; v++, n--) w -= v->iov_len;
+        if (n > 0) {
+            v->iov_base = (char *)v->iov_base + w;
+            v->iov_len -= w;
+        }
+    }
+    s->n = 0;
+}
+
+static void sink_add(struct sink *s, const char *p, size_t len) {
+    if (s->n > 0) {
+        struct iovec *last = &s->iov[s->n - 1];
+        if ((const char *)last->iov_base + last->iov_len == p) {
+            last->iov_len += len;
+            return;
+        }
+    }
+    if (s->n == SINK_IOV) sink_flush(s);
+    s->iov[s->n++] = (struct iovec){ (void *)p, len };
+}
+
+static int write_all(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0) return -1;
+        p += w;
+        n -= w;
+    }
+    return 0;
+}
+
+static int read_some(int fd, char *buf, size_t size) {
+    ssize_t n;
+    while ((n = read(fd, buf, size)) < 0 && errno == EINTR) {}
+    return n;
+}
+
+// Check the operands from args[i] on for an operands callback. An option
+// among them means GNU argument permutation, left to the external command.
+static int plain_operands(char **args, int i) {
+    int files = 0;
+    for (; args[i]; i++) {
+        if (args[i][0] == '-' && args[i][1]) return -1;
+        if (strcmp(args[i], "-") == 0) continue;
+        if (!finite_file(args[i])) return -1;
+        files = 1;
+    }
+    return files;
+}
+
+static int open_operand(const char *name, struct builtin_io *io) {
+    return strcmp(name, "-") == 0 ? io->in : open(name, O_RDONLY | O_CLOEXEC);
+}
+
+// --- head ---
+// head [-n N | -N | -c N] [file...]
+struct head_opts {
+    int bytes;
+    uint64_t count;
+    int first;      // index of the first operand
+};
+
+static int parse_count(const char *s, uint64_t *v) {
+    char *end;
+    if (!s || !*s || strspn(s, "0123456789") != strlen(s)) return -1;
+    errno = 0;
+    *v = strtoull(s, &end, 10);
+    return errno ? -1 : 0;
+}
+
+static int parse_head(char **args, struct head_opts *o) {
+    o->bytes = 0;
+    o->count = 10;
+    int i = 1;
+    for (; args[i] && args[i][0] == '-' && args[i][1]; i++) {
+        const char *a = args[i];
+        const char *value;
+        if (a[1] == 'n' || a[1] == 'c') {
+            o->bytes = a[1] == 'c';
+            value = a[2] ? a + 2 : args[++i];
+        } else if (a[1] >= '0' && a[1] <= '9' && i == 1) {
+            value = a + 1;
+        } else {
+            return -1;
+        }
+        if (parse_count(value, &o->count) < 0) return -1;
+    }
+    o->first = i;
+    return plain_operands(args, i);
+}
+
+int head_operands(char **args) {
+    struct head_opts o;
+    return parse_head(args, &o);
+}
+
+// Returns 0, or -1 with errno set (EPIPE meaning the output went away)
+static int head_fd(int in, int out, const struct head_opts *o, char *buf) {
+    if (o->bytes) return copy_data(in, out, o->count);
+
+    uint64_t left = o->count;
+    while (left > 0) {
+        int n = read_some(in, buf, FILTER_BUFSIZE);
+        if (n <= 0) return n;
+        const char *end = skip_lines(buf, n, &left);
+        if (write_all(out, buf, end ? end - buf : n) < 0) return -1;
+    }
+    return 0;
+}
+
+int builtin_head(char **args, struct builtin_io *io) {
+    static char *stdin_only[] = { "-", NULL };
+    struct head_opts o;
+    if (parse_head(args, &o) < 0) {
+        dprintf(io->err, "head: unsupported arguments\n");
+        return 1;
+    }
+    char **files = args[o.first] ? args + o.first : stdin_only;
+    int headers = files[0] && files[1];
+    char *buf = o.bytes ? NULL : malloc(FILTER_BUFSIZE);
+    int status = 0, shown = 0;
+
+    for (; *files; files++) {
+        int in = open_operand(*files, io);
+        if (in < 0) {
+            dprintf(io->err, "head: cannot open '%s' for reading: %s\n", *files, strerror(errno));
+            status = 1;
+            continue;
+        }
+        if (headers) {
+            dprintf(io->out, "%s==> %s <==\n", shown++ ? "\n" : "",
+                    in == io->in ? "standard input" : *files);
+        }
+        int r = head_fd(in, io->out, &o, buf);
+        if (in != io->in) close(in);
+        if (r < 0 && errno == EPIPE) {
+            free(buf);
+            return STATUS_EPIPE;
+        }
+        if (r < 0) {
+            dprintf(io->err, "head: error reading '%s': %s\n", *files, strerror(errno));
+            status = 1;
+        }
+    }
+    free(buf);
+    return status;
+}
+
+// --- wc ---
+// wc -l / -c / -lc [file...], laid out as GNU wc does: columns as wide as
+// the total size of the regular-file inputs (at least 7 if one is not a
+// regular file), or unpadded for a single count of a single input.
+struct wc_opts {
+    int lines;
+    int bytes;
+    int first;
+};
+
+static int parse_wc(char **args, struct wc_opts *o) {
+    o->lines = o->bytes = 0;
+    int i = 1;
+    for (; args[i] && args[i][0] == '-' && args[i][1]; i++) {
+        for (const char *f = args[i] + 1; *f; f++) {
+            if (*f == 'l') o->lines = 1;
+            else if (*f == 'c') o->bytes = 1;
+            else return -1;
+        }
+    }
+    // Plain wc also counts words, which depend on the locale
+    if (!o->lines && !o->bytes) return -1;
+    o->first = i;
+    return plain_operands(args, i);
+}
+
+int wc_operands(char **args) {
+    struct wc_opts o;
+    return parse_wc(args, &o);
+}
+
+static int wc_fd(int in, const struct wc_opts *o, uint64_t *lines, uint64_t *bytes, char *buf) {
+    struct stat st;
+    if (!o->lines && fstat(in, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        off_t pos = lseek(in, 0, SEEK_CUR);
+        if (pos >= 0) {
+            *bytes = st.st_size > pos ? st.st_size - pos : 0;
+            return 0;
+        }
+    }
+    for (;;) {
+        int n = read_some(in, buf, FILTER_BUFSIZE);
+        if (n <= 0) return n;
+        *bytes += n;
+        if (o->lines) *lines += count_byte(buf, n, '\n');
+    }
+}
+
+static void wc_print(struct outbuf *out, const struct wc_opts *o, int width,
+                     uint64_t lines, uint64_t bytes, const char *name) {
+    char line[128];
+    int len = 0;
+    if (o->lines) {
+        len += snprintf(line + len, sizeof(line) - len, "%*llu", width, (unsigned long long)lines);
+    }
+    if (o->bytes) {
+        len += snprintf(line + len, sizeof(line) - len, len ? " %*llu" : "%*llu", width,
+                        (unsigned long long)bytes);
+    }
+    out_write(out, line, len);
+    if (name) {
+        out_write(out, " ", 1);
+        out_str(out, name);
+    }
+    out_write(out, "\n", 1);
+}
+
+int builtin_wc(char **args, struct builtin_io *io) {
+    static char *stdin_only[] = { NULL, NULL };
+    struct wc_opts o;
+    if (parse_wc(args, &o) < 0) {
+        dprintf(io->err, "wc: unsupported arguments\n");
+        return 1;
+    }
+    char **files = args[o.first] ? args + o.first : stdin_only;
+    int nfiles = 0;
+    while (files[nfiles] || (nfiles == 0 && files == stdin_only)) nfiles++;
+
+    int width = 1;
+    if (nfiles > 1 || o.lines + o.bytes > 1) {
+        int minimum = 1;
+        uint64_t regular = 0;
+        for (int i = 0; i < nfiles; i++) {
+            struct stat st;
+            int stdin_operand = !files[i] || strcmp(files[i], "-") == 0;
+            int r = stdin_operand ? fstat(io->in, &st) : stat(files[i], &st);
+            if (r < 0) continue;
+            if (S_ISREG(st.st_mode)) regular += st.st_size;
+            else minimum = 7;
+        }
+        for (; regular >= 10; regular /= 10) width++;
+        if (width < minimum) width = minimum;
+    }
+
+    struct outbuf out = { .fd = io->out };
+    char *buf = malloc(FILTER_BUFSIZE);
+    uint64_t total_lines = 0, total_bytes = 0;
+    int status = 0;
+    for (int i = 0; i < nfiles; i++) {
+        int in = files[i] ? open_operand(files[i], io) : io->in;
+        if (in < 0) {
+            out_flush(&out);
+            dprintf(io->err, "wc: %s: %s\n", files[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+        uint64_t lines = 0, bytes = 0;
+        int r = wc_fd(in, &o, &lines, &bytes, buf);
+        if (r < 0) {
+            out_flush(&out);
+            dprintf(io->err, "wc: %s: %s\n", files[i] ? files[i] : "-", strerror(errno));
+            status = 1;
+        }
+        if (in != io->in) close(in);
+        wc_print(&out, &o, width, lines, bytes, files[i]);
+        total_lines += lines;
+        total_bytes += bytes;
+    }
+    if (nfiles > 1) wc_print(&out, &o, width, total_lines, total_bytes, "total");
+    out_flush(&out);
+    free(buf);
+    return status || out.failed;
+}
+
+// --- grep -F ---
+// grep -F [-v] [-c] [-q] pattern [file...], one literal pattern. Input
+// with a NUL byte is binary, as for GNU grep in the C locale: from the
+// buffer holding the first NUL on, matching lines are not printed and a
+// "binary file matches" note on stderr replaces them. GNU grep's buffers
+// are larger, so a NUL beyond the first 128 KiB can cut output at a
+// different line.
+struct grep_opts {
+    int invert;
+    int count;
+    int quiet;
+    const char *pattern;
+    int first;
+};
+
+static int parse_grep(char **args, struct grep_opts *o) {
+    int fixed = 0;
+    o->invert = o->count = o->quiet = 0;
+    int i = 1;
+    for (; args[i] && args[i][0] == '-' && args[i][1]; i++) {
+        for (const char *f = args[i] + 1; *f; f++) {
+            if (*f == 'F') fixed = 1;
+            else if (*f == 'v') o->invert = 1;
+            else if (*f == 'c') o->count = 1;
+            else if (*f == 'q') o->quiet = 1;
+            else return -1;
+        }
+    }
+    // Regular expressions and multi-line pattern lists are grep's job
+    if (!fixed || !args[i] || strchr(args[i], '\n')) return -1;
+    o->pattern = args[i];
+    o->first = i + 1;
+    return plain_operands(args, i + 1);
+}
+
+int grep_operands(char **args) {
+    struct grep_opts o;
+    return parse_grep(args, &o);
+}
+
+struct grep_state {
+    const struct grep_opts *o;
+    size_t plen;
+    const char *prefix;     // "name:" when several files are searched
+    uint64_t selected;
+    int binary;
+    int binary_match;
+    struct sink out;
+};
+
+// Select the complete lines in [p, end), which ends with a newline
+static void grep_lines(struct grep_state *g, const char *p, const char *end) {
+    if (!g->prefix || g->o->count || g->binary) {
+        g->selected += count_byte(p, end - p, '\n');
+        if (g->binary) g->binary_match = 1;
+        else if (!g->o->count) sink_add(&g->out, p, end - p);
+        return;
+    }
+    while (p < end) {
+        const char *nl = (const char *)memchr(p, '\n', end - p) + 1;
+        g->selected++;
+        sink_add(&g->out, g->prefix, strlen(g->prefix));
+        sink_add(&g->out, p, nl - p);
+        p = nl;
+    }
+}
+
+// Search whole lines [p, end). Returns 1 once -q has its answer.
+static int grep_chunk(struct grep_state *g, const char *p, const char *end) {
+    const struct grep_opts *o = g->o;
+    if (!g->binary && memchr(p, '\0', end - p)) g->binary = 1;
+
+    while (p < end) {
+        const char *m = find_literal(p, end - p, o->pattern, g->plen);
+        const char *start = end, *next = end;
+        if (m) {
+            const char *nl = memrchr(p, '\n', m - p);
+            start = nl ? nl + 1 : p;
+            next = (const char *)memchr(m, '\n', end - m) + 1;
+        }
+        // [p, start) are lines without a match, [start, next) the matching one
+        const char *from = o->invert ? p : start, *to = o->invert ? start : next;
+        if (from < to) {
+            if (o->quiet) {
+                g->selected++;
+                return 1;
+            }
+            grep_lines(g, from, to);
+        }
+        p = next;
+    }
+    return 0;
+}
+
+// Returns 1 if -q is satisfied, 0 at EOF, or -1 with errno set
+static int grep_fd(struct grep_state *g, int in, char **buf, size_t *cap) {
+    size_t len = 0;
+    for (;;) {
+        // One byte stays spare for the newline a final line may lack
+        if (len + 1 >= *cap) {
+            *cap *= 2;
+            char *grown = realloc(*buf, *cap);
+            if (!grown) {
+                errno = ENOMEM;
+                return -1;
+            }
+            *buf = grown;
+        }
+        int n = read_some(in, *buf + len, *cap - len - 1);
+        if (n < 0) return -1;
+        size_t scanned = len;
+        if (n > 0) len += n;
+        else if (len > 0) (*buf)[len++] = '\n';
+        else return 0;
+        char *last = memrchr(*buf + scanned, '\n', len - scanned);
+        if (!last) continue;
+
+        size_t whole = last + 1 - *buf;
+        int done = grep_chunk(g, *buf, *buf + whole);
+        sink_flush(&g->out);
+        if (done) return 1;
+        if (g->out.failed) {
+            errno = g->out.failed;
+            return -1;
+        }
+        memmove(*buf, *buf + whole, len - whole);
+        len -= whole;
+        if (n == 0) return 0;
+    }
+}
+
+int builtin_grep(char **args, struct builtin_io *io) {
+    static char *stdin_only[] = { "-", NULL };
+    struct grep_opts o;
+    if (parse_grep(args, &o) < 0) {
+        dprintf(io->err, "grep: unsupported arguments\n");
+        return 2;
+    }
+    char **files = args[o.first] ? args + o.first : stdin_only;
+    int several = files[0] && files[1];
+    size_t cap = FILTER_BUFSIZE;
+    char *buf = malloc(cap);
+    uint64_t selected = 0;
+    int error = 0;
+
+    for (; *files; files++) {
+        const char *name = strcmp(*files, "-") == 0 ? "(standard input)" : *files;
+        int in = open_operand(*files, io);
+        if (in < 0) {
+            dprintf(io->err, "grep: %s: %s\n", *files, strerror(errno));
+            error = 1;
+            continue;
+        }
+
+        char prefix[PATH_MAX + 2];
+        struct grep_state g = { &o, strlen(o.pattern), NULL, 0, 0, 0, { .fd = io->out } };
+        if (several) {
+            snprintf(prefix, sizeof(prefix), "%s:", name);
+            g.prefix = prefix;
+        }
+        int r = buf ? grep_fd(&g, in, &buf, &cap) : (errno = ENOMEM, -1);
+        if (in != io->in) close(in);
+        selected += g.selected;
+
+        if (r > 0) break;
+        if (r < 0 && errno == EPIPE) {
+            free(buf);
+            return STATUS_EPIPE;
+        }
+        if (r < 0) {
+            dprintf(io->err, "grep: %s: %s\n", name, strerror(errno));
+            error = 1;
+        }
+        if (o.count && !o.quiet) {
+            dprintf(io->out, "%s%llu\n", g.prefix ? g.prefix : "", (unsigned long long)g.selected);
+        } else if (g.binary_match && !o.quiet) {
+            dprintf(io->err, "grep: %s: binary file matches\n", name);
+        }
+    }
+    free(buf);
+    if (o.quiet && selected) return 0;
+    return error ? 2 : selected ? 0 : 1;
+}
+
+// --- tee ---
+// tee [-a] [file...]
+static int parse_tee(char **args, int *append) {
+    *append = 0;
+    int i = 1;
+    for (; args[i] && args[i][0] == '-' && args[i][1]; i++) {
+        if (strcmp(args[i], "-a") != 0) return -1;
+        *append = 1;
+    }
+    for (int k = i; args[k]; k++) {
+        if (args[k][0] == '-') return -1;
+    }
+    return i;
+}
+
+int tee_operands(char **args) {
+    int append;
+    return parse_tee(args, &append) < 0 ? -1 : 0;
+}
+
+int builtin_tee(char **args, struct builtin_io *io) {
+    int append;
+    int first = parse_tee(args, &append);
+    if (first < 0) {
+        dprintf(io->err, "tee: unsupported arguments\n");
+        return 1;
+    }
+
+    char **names = args + first;
+    int total = 0, nfiles = 0, status = 0;
+    while (names[total]) total++;
+    int *fds = malloc((1 + total) * sizeof(int));
+    char *buf = malloc(FILTER_BUFSIZE);
+    if (!fds || !buf) {
+        free(fds);
+        free(buf);
+        dprintf(io->err, "tee: %s\n", strerror(ENOMEM));
+        return 1;
+    }
+
+    // Slot 0 is stdout; a file that fails is dropped (-1) and the rest go on
+    fds[nfiles++] = io->out;
+    for (int i = 0; i < total; i++) {
+        int mode = append ? O_APPEND : O_TRUNC;
+        int fd = open(names[i], O_WRONLY | O_CREAT | O_CLOEXEC | mode, 0666);
+        if (fd < 0) {
+            dprintf(io->err, "tee: %s: %s\n", names[i], strerror(errno));
+            status = 1;
+        }
+        fds[nfiles++] = fd;
+    }
+
+    int n;
+    while ((n = read_some(io->in, buf, FILTER_BUFSIZE)) > 0) {
+        for (int i = 0; i < nfiles; i++) {
+            if (fds[i] < 0 || write_all(fds[i], buf, n) == 0) continue;
+            if (i == 0 && errno == EPIPE) {
+                status = STATUS_EPIPE;
+                goto done;
+            }
+            dprintf(io->err, "tee: %s: %s\n", i ? names[i - 1] : "standard output",
+                    strerror(errno));
+            if (i > 0) close(fds[i]);
+            fds[i] = -1;
+            status = 1;
+        }
+    }
+    if (n < 0) {
+        dprintf(io->err, "tee: read error: %s\n", strerror(errno));
+        status = 1;
+    }
+
+done:
+    for (int i = 1; i < nfiles; i++) {
+        if (fds[i] >= 0) close(fds[i]);
+    }
+    free(fds);
+    free(buf);
+    return status;
+}
@@ -0,0 +1,17 @@
+#ifndef FILTERS_H
+#define FILTERS_H
+
+#include "builtins.h"
+
+// In-process head, wc, grep -F and tee for pipeline stages; each has an
+// operands check for struct builtin
+int builtin_head(char **args, struct builtin_io *io);
+int builtin_wc(char **args, struct builtin_io *io);
+int builtin_grep(char **args, struct builtin_io *io);
+int builtin_tee(char **args, struct builtin_io *io);
+int head_operands(char **args);
+int wc_operands(char **args);
+int grep_operands(char **args);
+int tee_operands(char **args);
+
+#endif
@@ -0,0 +1,262 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <limits.h>
+
+#include "history.h"
+#include "arena.h"
+
+// === Command History ===
+// History is an append-only log, one command per line, in
+// $SHELL_HISTFILE (default ~/.myshell_history). On first use the log is
+// mapped and indexed: entries point straight into the mapping, so recall
+// by number is an array lookup and nothing is copied. New commands are
+// appended to the file with a single write and their text kept in an
+// arena. Once the log holds twice $SHELL_HISTSIZE entries it is rewritten
+// with only the newest $SHELL_HISTSIZE, so it never grows without bound.
+struct hist_entry {
+    const char *text;       // not NUL-terminated
+    size_t len;
+    struct sequence *seq;   // parsed on first replay, then reused
+};
+
+static int loaded;
+static int log_fd = -1;
+static char *log_path;
+static char *map;
+static size_t map_size;
+
+static struct hist_entry *entries;
+static int nentries, entries_cap;
+static int nmapped;             // entries[0..nmapped) point into map
+static int base = 1;            // number of entries[0]
+static int max_entries;
+
+static struct arena store;      // appended text and cached parses
+static struct parser hist_parser;
+
+static void push_entry(const char *text, size_t len) {
+    if (nentries == entries_cap) {
+        entries_cap = entries_cap ? entries_cap * 2 : 256;
+        entries = realloc(entries, entries_cap * sizeof(*entries));
+        if (!entries) {
+            perror("history allocation failed");
+            exit(1);
+        }
+    }
+    entries[nentries].text = text;
+    entries[nentries].len = len;
+    entries[nentries].seq = NULL;
+    nentries++;
+}
+
+// Replace the log with the total bytes in buf. The new file is renamed
+// over the old one, never truncated in place, so the mappings of this
+// and other running shells stay valid.
+static void replace_log(const char *buf, size_t total, const char *what) {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.%d", log_path, (int)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0 || write(fd, buf, total) != (ssize_t)total || rename(tmp, log_path) < 0) {
+        perror(what);
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmp);
+        }
+        return;
+    }
+    close(fd);
+
+    close(log_fd);
+    log_fd = open(log_path, O_WRONLY | O_APPEND | O_CLOEXEC);
+}
+
+// Rewrite the log with the newest max_entries entries
+static void compact() {
+    int drop = nentries - max_entries;
+    if (drop <= 0) return;
+    memmove(entries, entries + drop, (nentries - drop) * sizeof(*entries));
+    nentries -= drop;
+    nmapped = nmapped > drop ? nmapped - drop : 0;
+    base += drop;
+    if (log_fd < 0) return;
+
+    size_t total = 0;
+    for (int i = 0; i < nentries; i++) total += entries[i].len + 1;
+    char *buf = malloc(total ? total : 1);
+    if (!buf) return;
+    char *p = buf;
+    for (int i = 0; i < nentries; i++) {
+        memcpy(p, entries[i].text, entries[i].len);
+        p += entries[i].len;
+        *p++ = '\n';
+    }
+    replace_log(buf, total, "history compaction failed");
+    free(buf);
+}
+
+static void load_history() {
+    loaded = 1;
+
+    const char *env = getenv("SHELL_HISTSIZE");
+    max_entries = env && atoi(env) > 0 ? atoi(env) : HISTORY_DEFAULT_SIZE;
+
+    if ((env = getenv("SHELL_HISTFILE"))) {
+        log_path = strdup(env);
+    } else if ((env = getenv("HOME"))) {
+        if (asprintf(&log_path, "%s/.myshell_history", env) < 0) log_path = NULL;
+    }
+    if (!log_path) return;
+
+    // O_APPEND: each entry is one write, so concurrent shells interleave
+    // whole lines
+    int fd = open(log_path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        perror("history file open failed");
+        return;
+    }
+    log_fd = fd;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) return;
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        map = NULL;
+        return;
+    }
+    map_size = st.st_size;
+
+    const char *p = map, *end = map + map_size;
+    while (p < end) {
+        const char *nl = memchr(p, '\n', end - p);
+        if (!nl) nl = end;
+        if (nl > p) push_entry(p, nl - p);
+        p = nl + 1;
+    }
+    nmapped = nentries;
+
+    if (nentries > 2 * max_entries) compact();
+}
+
+// Record one line as typed (a trailing newline is dropped). Blank lines
+// are not recorded.
+void history_add(const char *line, size_t len) {
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) len--;
+    size_t i = 0;
+    while (i < len && (line[i] == ' ' || line[i] == '\t')) i++;
+    if (i == len) return;
+
+    if (!loaded) load_history();
+    push_entry(arena_strndup(&store, line, len), len);
+
+    if (log_fd >= 0) {
+        struct iovec iov[2] = { { (void *)line, len }, { "\n", 1 } };
+        if (writev(log_fd, iov, 2) < 0) perror("history write failed");
+    }
+    if (nentries > 2 * max_entries) compact();
+}
+
+// Numbers of the oldest and newest entries (first > last when empty)
+int history_first() {
+    if (!loaded) load_history();
+    return base;
+}
+
+int history_last() {
+    if (!loaded) load_history();
+    return base + nentries - 1;
+}
+
+const char *history_get(int n, size_t *len) {
+    if (!loaded) load_history();
+    if (n < base || n >= base + nentries) return NULL;
+    *len = entries[n - base].len;
+    return entries[n - base].text;
+}
+
+// Parsed form of entry n. Each entry is lexed at most once per session.
+struct sequence *history_sequence(int n, const char **error) {
+    if (!loaded) load_history();
+    if (n < base || n >= base + nentries) {
+        *error = "no such entry";
+        return NULL;
+    }
+    struct hist_entry *e = &entries[n - base];
+    if (!e->seq) {
+        struct sequence *seq = parse_line(&hist_parser, e->text, e->len);
+        if (!seq) {
+            *error = hist_parser.error;
+            return NULL;
+        }
+        e->seq = copy_sequence(&store, seq);
+    }
+    return e->seq;
+}
+
+// Index of the mapped entry containing address p
+static int mapped_entry_at(const char *p) {
+    int lo = 0, hi = nmapped - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (entries[mid].text <= p) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
+
+// Call fn for every entry that starts with (prefix) or contains needle,
+// oldest first. Returns the number of matches.
+int history_search(const char *needle, int prefix, history_fn fn, void *arg) {
+    if (!loaded) load_history();
+    size_t nlen = strlen(needle);
+    int matches = 0;
+    int i = 0;
+
+    // Substrings in the mapped part are found with one memmem() pass over
+    // the log instead of one call per entry
+    if (!prefix && nlen > 0 && nmapped > 0) {
+        const char *p = entries[0].text;
+        const char *end = entries[nmapped - 1].text + entries[nmapped - 1].len;
+        while (p < end) {
+            const char *hit = memmem(p, end - p, needle, nlen);
+            if (!hit) break;
+            int k = mapped_entry_at(hit);
+            struct hist_entry *e = &entries[k];
+            if (hit + nlen <= e->text + e->len) {
+                fn(base + k, e->text, e->len, arg);
+                matches++;
+            }
+            p = e->text + e->len;
+        }
+        i = nmapped;
+    }
+
+    for (; i < nentries; i++) {
+        struct hist_entry *e = &entries[i];
+        if (e->len < nlen) continue;
+        int hit = prefix ? memcmp(e->text, needle, nlen) == 0
+                         : memmem(e->text, e->len, needle, nlen) != NULL;
+        if (!hit) continue;
+        fn(base + i, e->text, e->len, arg);
+        matches++;
+    }
+    return matches;
+}
+
+// Forget every entry and empty the log
+void history_clear() {
+    if (!loaded) load_history();
+    nentries = nmapped = 0;
+    base = 1;
+    if (map) munmap(map, map_size);
+    map = NULL;
+    map_size = 0;
+    arena_reset(&store);
+    if (log_fd >= 0) replace_log("", 0, "history clear failed");
+}
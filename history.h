@@ -0,0 +1,21 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include "parse.h"
+
+// Entries kept after compaction unless $SHELL_HISTSIZE says otherwise
+#define HISTORY_DEFAULT_SIZE 50000
+
+// Called by history_search with each matching entry's number and text
+typedef void (*history_fn)(int n, const char *text, size_t len, void *arg);
+
+void history_add(const char *line, size_t len);
+int history_first();
+int history_last();
+const char *history_get(int n, size_t *len);
+struct sequence *history_sequence(int n, const char **error);
+int history_search(const char *needle, int prefix, history_fn fn, void *arg);
+void history_clear();
+
+#endif
@@ -0,0 +1,259 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "incremental.h"
+#include "builtins.h"
+#include "path.h"
+#include "script.h"
+#include "trace.h"
+
+// === Incremental Execution ===
+// A pipeline that writes its result to files is treated like a make rule.
+// Its key hashes the cwd and every command's argv and redirections. Its
+// inputs hash the identity (device, inode, size, mtime) of each
+// executable and each '<' file, and its outputs the identity of each
+// file it truncates ('>', '2>', '&>'). Appending redirections make a
+// pipeline ineligible, since a skipped run would leave the file short.
+// After a successful run the three are stored; the next time the same
+// key comes up with the same inputs and untouched outputs, the pipeline
+// is skipped with status 0.
+//
+// The store is $SHELL_CACHE_DIR/fingerprints: a header and 24-byte
+// records, appended with one write each, later records winning. It is
+// read into a hash table on first use and rewritten without stale
+// records when they outnumber the live ones.
+#define FP_MAGIC "SHFP"
+#define FP_VERSION 1
+
+struct fp_header {
+    char magic[4];
+    uint32_t version;
+};
+
+struct fp_record {
+    uint64_t key;           // 0 marks an empty slot
+    uint64_t inputs;
+    uint64_t outputs;
+};
+
+int incremental = 0;
+
+static int loaded;
+static int store_fd = -1;
+static char store_path[PATH_MAX + 32];
+static struct fp_record *table;
+static size_t table_size, live;
+
+static uint64_t hash_bytes(uint64_t h, const void *p, size_t n) {
+    const unsigned char *s = p;
+    for (size_t i = 0; i < n; i++) h = (h ^ s[i]) * 0x100000001b3ull;
+    return h;
+}
+
+static uint64_t hash_str(uint64_t h, const char *s) {
+    return hash_bytes(h, s, strlen(s) + 1);
+}
+
+// A missing file hashes differently from every existing one
+static uint64_t hash_file(uint64_t h, const char *path) {
+    struct stat st;
+    uint64_t id[5] = { 0 };
+    if (stat(path, &st) == 0) {
+        id[0] = st.st_dev;
+        id[1] = st.st_ino;
+        id[2] = st.st_size;
+        id[3] = st.st_mtim.tv_sec;
+        id[4] = st.st_mtim.tv_nsec;
+    }
+    return hash_bytes(h, id, sizeof(id));
+}
+
+static struct fp_record *find_slot(uint64_t key) {
+    size_t i = key & (table_size - 1);
+    while (table[i].key && table[i].key != key) i = (i + 1) & (table_size - 1);
+    return &table[i];
+}
+
+static void put_record(const struct fp_record *r) {
+    if ((live + 1) * 2 > table_size) {
+        struct fp_record *old = table;
+        size_t old_size = table_size;
+        table_size = table_size ? table_size * 2 : 1024;
+        table = calloc(table_size, sizeof(*table));
+        if (!table) {
+            perror("fingerprint table allocation failed");
+            exit(1);
+        }
+        for (size_t i = 0; i < old_size; i++) {
+            if (old[i].key) *find_slot(old[i].key) = old[i];
+        }
+        free(old);
+    }
+    struct fp_record *slot = find_slot(r->key);
+    if (!slot->key) live++;
+    *slot = *r;
+}
+
+// Rewrite the store with only the live records
+static void compact_store() {
+    char tmp[PATH_MAX + 48];
+    snprintf(tmp, sizeof(tmp), "%s.%d", store_path, (int)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return;
+
+    struct fp_header h = { FP_MAGIC, FP_VERSION };
+    size_t size = sizeof(h) + live * sizeof(struct fp_record);
+    char *buf = malloc(size);
+    if (!buf) {
+        close(fd);
+        unlink(tmp);
+        return;
+    }
+    memcpy(buf, &h, sizeof(h));
+    struct fp_record *out = (struct fp_record *)(buf + sizeof(h));
+    for (size_t i = 0; i < table_size; i++) {
+        if (table[i].key) *out++ = table[i];
+    }
+    if (write(fd, buf, size) != (ssize_t)size || rename(tmp, store_path) < 0) {
+        unlink(tmp);
+    } else {
+        close(store_fd);
+        store_fd = open(store_path, O_WRONLY | O_APPEND | O_CLOEXEC);
+    }
+    free(buf);
+    close(fd);
+}
+
+static void load_store() {
+    loaded = 1;
+
+    char dir[4096];
+    if (cache_dir(dir, sizeof(dir)) < 0) return;
+    snprintf(store_path, sizeof(store_path), "%s/%s", dir, FINGERPRINT_FILE);
+
+    store_fd = open(store_path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (store_fd < 0) {
+        perror("fingerprint store open failed");
+        return;
+    }
+
+    struct stat st;
+    struct fp_header h;
+    char *buf = NULL;
+    size_t nrecords = 0;
+    if (fstat(store_fd, &st) == 0 && st.st_size >= (off_t)sizeof(h)) {
+        buf = malloc(st.st_size);
+        if (buf && pread(store_fd, buf, st.st_size, 0) == st.st_size) {
+            memcpy(&h, buf, sizeof(h));
+            if (memcmp(h.magic, FP_MAGIC, 4) == 0 && h.version == FP_VERSION) {
+                nrecords = (st.st_size - sizeof(h)) / sizeof(struct fp_record);
+            }
+        }
+    }
+    for (size_t i = 0; i < nrecords; i++) {
+        struct fp_record r;
+        memcpy(&r, buf + sizeof(h) + i * sizeof(r), sizeof(r));
+        if (r.key) put_record(&r);
+    }
+    free(buf);
+
+    // An empty, foreign or stale-heavy file is rewritten from the table
+    if (nrecords == 0 || nrecords > 2 * live + 1024) compact_store();
+}
+
+static int is_output(int type) {
+    return type == REDIR_OUT || type == REDIR_ERR || type == REDIR_ALL;
+}
+
+// Whether every command can be fingerprinted and the last one's output
+// goes to a file (otherwise skipping it would lose what it prints).
+// Fan-outs are never fingerprinted.
+static int eligible(struct pipeline *pl) {
+    if (pl->background || pl->nbranches) return 0;
+    for (int i = 0; i < pl->ncmds; i++) {
+        struct command *cmd = &pl->cmds[i];
+        if (cmd->argc == 0) return 0;
+        const struct builtin *b = find_builtin(cmd->argv[0]);
+        if (b && !(b->flags & BI_PURE)) return 0;
+        for (struct redir *r = cmd->redirs; r; r = r->next) {
+            if (redir_appends(r->type)) return 0;
+        }
+    }
+
+    // Where stdout ends up after the redirections, left to right
+    int out_file = 0;
+    for (struct redir *r = pl->cmds[pl->ncmds - 1].redirs; r; r = r->next) {
+        if (r->type == REDIR_OUT || r->type == REDIR_ALL) out_file = 1;
+        else if (r->type == REDIR_OUT_TO_ERR) out_file = 0;
+    }
+    return out_file;
+}
+
+static uint64_t hash_outputs(struct pipeline *pl) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (int i = 0; i < pl->ncmds; i++) {
+        for (struct redir *r = pl->cmds[i].redirs; r; r = r->next) {
+            if (is_output(r->type)) h = hash_file(h, r->target);
+        }
+    }
+    return h;
+}
+
+// Returns 1 if pl's last successful run is still current, 0 if it must
+// run (fp is then ready for fingerprint_record), or -1 if pl cannot be
+// fingerprinted
+int fingerprint_up_to_date(struct pipeline *pl, struct fingerprint *fp) {
+    if (!eligible(pl)) return -1;
+    uint64_t t0 = trace_start();
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) return -1;
+    uint64_t key = hash_str(0xcbf29ce484222325ull, cwd);
+    uint64_t inputs = 0xcbf29ce484222325ull;
+
+    for (int i = 0; i < pl->ncmds; i++) {
+        struct command *cmd = &pl->cmds[i];
+        key = hash_bytes(key, "|", 1);
+        for (int k = 0; k < cmd->nassigns; k++) key = hash_str(key, cmd->assigns[k]);
+        for (int k = 0; k < cmd->argc; k++) key = hash_str(key, cmd->argv[k]);
+        for (struct redir *r = cmd->redirs; r; r = r->next) {
+            key = hash_str(key, redir_op(r->type));
+            key = hash_str(key, r->target);
+            if (r->type == REDIR_IN) inputs = hash_file(inputs, r->target);
+        }
+
+        if (!find_builtin(cmd->argv[0])) {
+            char *exec_path = find_executable(cmd->argv[0]);
+            if (!exec_path) return -1;
+            inputs = hash_str(inputs, exec_path);
+            inputs = hash_file(inputs, exec_path);
+        }
+    }
+
+    fp->key = key ? key : 1;
+    fp->inputs = inputs;
+    if (!loaded) load_store();
+
+    int fresh = 0;
+    if (table_size) {
+        struct fp_record *r = find_slot(fp->key);
+        fresh = r->key && r->inputs == inputs && r->outputs == hash_outputs(pl);
+    }
+    trace_span("fingerprint", t0, pl->cmds[0].argv[0], strlen(pl->cmds[0].argv[0]));
+    return fresh;
+}
+
+// Remember a successful run of pl, fingerprinted before it ran
+void fingerprint_record(struct pipeline *pl, const struct fingerprint *fp) {
+    struct fp_record r = { fp->key, fp->inputs, hash_outputs(pl) };
+    put_record(&r);
+    if (store_fd >= 0 && write(store_fd, &r, sizeof(r)) != sizeof(r)) {
+        perror("fingerprint store write failed");
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <stdint.h>
+#include "parse.h"
+
+#define FINGERPRINT_FILE "fingerprints"
+
+extern int incremental;     // -I: every eligible pipeline, not just 'cached' ones
+
+// What a pipeline's last run depended on; see incremental.c
+struct fingerprint {
+    uint64_t key;
+    uint64_t inputs;
+};
+
+int fingerprint_up_to_date(struct pipeline *pl, struct fingerprint *fp);
+void fingerprint_record(struct pipeline *pl, const struct fingerprint *fp);
+
+#endif
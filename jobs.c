@@ -0,0 +1,520 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "jobs.h"
+#include "stats.h"
+#include "trace.h"
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+// === Child Reaping ===
+// Every child gets a pidfd registered in one epoll set, so an exit wakes
+// the shell for exactly that job and is collected with waitid(P_PIDFD),
+// which can never pick up a recycled pid. SIGCHLD is blocked and read
+// from a signalfd in the same set; it only serves to notice stops and
+// continues, which pidfds do not report. Nothing runs in signal context.
+static int epfd = -1;
+static int sigfd = -1;
+int job_control = 0;
+struct rusage job_rusage;
+static pid_t shell_pgid;
+
+static struct job **table;      // background and stopped jobs, by slot
+static int table_size;
+static struct job *current;     // foreground job being waited for
+
+void init_jobs(int interactive) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (epfd < 0 || sigfd < 0) {
+        perror("job control setup failed");
+        exit(1);
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, sigfd, &ev);
+
+    // Take the terminal so foreground jobs can be given it in turn
+    if (interactive && isatty(STDIN_FILENO)) {
+        job_control = 1;
+        signal(SIGTTOU, SIG_IGN);
+        setpgid(0, 0);
+        shell_pgid = getpgrp();
+        tcsetpgrp(STDIN_FILENO, shell_pgid);
+    }
+}
+
+// A forked copy of the shell (e.g. a parallel batch slot) must not share
+// the parent's epoll set or claim its jobs
+void reset_jobs_after_fork() {
+    close(epfd);
+    close(sigfd);
+    for (int i = 0; i < table_size; i++) table[i] = NULL;
+    current = NULL;
+    job_control = 0;
+    init_jobs(0);
+}
+
+struct job *job_create(struct pipeline *pl) {
+    struct job *j = calloc(1, sizeof(*j));
+    if (!j) {
+        perror("job allocation failed");
+        exit(1);
+    }
+    j->pl = pl;
+    return j;
+}
+
+// name labels the process in traces
+int job_add_process(struct job *j, pid_t pid, const char *name) {
+    if (j->nprocs == j->procs_cap) {
+        j->procs_cap = j->procs_cap ? j->procs_cap * 2 : 4;
+        j->procs = realloc(j->procs, j->procs_cap * sizeof(*j->procs));
+        if (!j->procs) {
+            perror("job allocation failed");
+            exit(1);
+        }
+    }
+    if (j->pgid == 0) j->pgid = pid;
+
+    struct job_proc *p = &j->procs[j->nprocs++];
+    p->pid = pid;
+    p->state = JOB_RUNNING;
+    if (trace_enabled) {
+        p->start = trace_start();
+        snprintf(p->name, sizeof(p->name), "%s", name);
+    }
+    p->pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (p->pidfd < 0) {
+        perror("pidfd_open failed");
+        return -1;
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = j };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, p->pidfd, &ev);
+    return 0;
+}
+
+static uint64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Kill j's process group if it is still running timeout seconds from
+// now: SIGTERM first, then SIGKILL kill_after seconds later. Background
+// jobs are checked whenever the shell reaps children.
+void job_set_timeout(struct job *j, double timeout, double kill_after) {
+    if (timeout <= 0) return;
+    j->deadline = now_ms() + (uint64_t)(timeout * 1000 + 0.5);
+    j->kill_after = kill_after * 1000 + 0.5;
+}
+
+// How long reap_jobs may sleep before j's next timeout signal is due
+static int deadline_wait(struct job *j) {
+    if (!j->deadline) return -1;
+    uint64_t now = now_ms();
+    return j->deadline > now ? (int)(j->deadline - now) : 0;
+}
+
+static void check_deadline(struct job *j) {
+    if (!j->deadline || j->state != JOB_RUNNING || now_ms() < j->deadline) return;
+    if (!j->timed_out) {
+        j->timed_out = 1;
+        kill(-j->pgid, SIGTERM);
+        j->deadline = now_ms() + j->kill_after;
+    } else {
+        kill(-j->pgid, SIGKILL);
+        j->deadline = 0;
+    }
+}
+
+// Forked children may still hold a copy of the pidfd, which would keep
+// it registered (with a stale job pointer) after close; remove it first
+static void close_pidfd(struct job_proc *p) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, p->pidfd, NULL);
+    close(p->pidfd);
+    p->pidfd = -1;
+}
+
+// Accumulate CPU time; ru_maxrss keeps the largest
+static void add_usage(struct rusage *total, const struct rusage *ru) {
+    timeradd(&total->ru_utime, &ru->ru_utime, &total->ru_utime);
+    timeradd(&total->ru_stime, &ru->ru_stime, &total->ru_stime);
+    if (ru->ru_maxrss > total->ru_maxrss) total->ru_maxrss = ru->ru_maxrss;
+}
+
+// Collect any state changes of j's processes and recompute its state
+static void update_job(struct job *j) {
+    int running = 0, stopped = 0;
+
+    for (int i = 0; i < j->nprocs; i++) {
+        struct job_proc *p = &j->procs[i];
+        siginfo_t info;
+
+        while (p->pidfd >= 0) {
+            // The raw syscall also reports the child's resource usage
+            struct rusage ru;
+            info.si_pid = 0;
+            int options = WEXITED | WSTOPPED | WCONTINUED | WNOHANG;
+            if (syscall(SYS_waitid, P_PIDFD, p->pidfd, &info, options, &ru) < 0) {
+                if (errno == EINTR) continue;
+                // Already gone (e.g. reaped elsewhere); treat as finished
+                p->state = JOB_DONE;
+                close_pidfd(p);
+                break;
+            }
+            if (info.si_pid == 0) break;
+
+            if (info.si_code == CLD_STOPPED || info.si_code == CLD_TRAPPED) {
+                p->state = JOB_STOPPED;
+            } else if (info.si_code == CLD_CONTINUED) {
+                p->state = JOB_RUNNING;
+            } else {
+                p->state = JOB_DONE;
+                close_pidfd(p);
+                add_usage(&j->usage, &ru);
+                trace_child_span("exec", p->start, p->pid, p->name);
+                if (p->pid == j->last_pid) {
+                    j->status = info.si_code == CLD_EXITED ? info.si_status : 128 + info.si_status;
+                }
+            }
+        }
+        if (p->state == JOB_RUNNING) running++;
+        if (p->state == JOB_STOPPED) stopped++;
+    }
+
+    if (running) j->state = JOB_RUNNING;
+    else if (stopped) j->state = JOB_STOPPED;
+    else j->state = JOB_DONE;
+}
+
+// Handle pending child events, waiting up to timeout_ms (-1 = forever)
+// for the first one
+void reap_jobs(int timeout_ms) {
+    // Wake for the next background timeout too
+    for (int k = 0; k < table_size; k++) {
+        int wait = table[k] ? deadline_wait(table[k]) : -1;
+        if (wait >= 0 && (timeout_ms < 0 || wait < timeout_ms)) timeout_ms = wait;
+    }
+
+    struct epoll_event events[32];
+    int n = epoll_wait(epfd, events, 32, timeout_ms);
+
+    for (int i = 0; i < n; i++) {
+        struct job *j = events[i].data.ptr;
+        if (j) {
+            update_job(j);
+            continue;
+        }
+
+        // SIGCHLD: something stopped or continued; rescan every job
+        struct signalfd_siginfo si;
+        while (read(sigfd, &si, sizeof(si)) == sizeof(si)) {}
+        if (current) update_job(current);
+        for (int k = 0; k < table_size; k++) {
+            if (table[k]) update_job(table[k]);
+        }
+    }
+    for (int k = 0; k < table_size; k++) {
+        if (table[k]) check_deadline(table[k]);
+    }
+}
+
+// Room for pl's text, as written by put_text()
+static size_t text_len(const struct pipeline *pl) {
+    size_t len = 0;
+    for (int i = 0; i < pl->ncmds; i++) {
+        struct command *cmd = &pl->cmds[i];
+        for (int k = 0; k < cmd->nassigns; k++) len += strlen(cmd->assigns[k]) + 1;
+        for (int k = 0; k < cmd->argc; k++) len += strlen(cmd->argv[k]) + 1;
+        for (struct redir *r = cmd->redirs; r; r = r->next) {
+            len += strlen(redir_op(r->type)) + strlen(r->target) + 2;
+        }
+        len += 3;
+    }
+    for (int b = 0; b < pl->nbranches; b++) len += text_len(&pl->branches[b]) + 6;
+    return len;
+}
+
+static char *put_text(char *p, const struct pipeline *pl) {
+    for (int i = 0; i < pl->ncmds; i++) {
+        struct command *cmd = &pl->cmds[i];
+        if (i > 0) p += sprintf(p, " | ");
+        for (int k = 0; k < cmd->nassigns; k++) p += sprintf(p, k ? " %s" : "%s", cmd->assigns[k]);
+        for (int k = 0; k < cmd->argc; k++) {
+            p += sprintf(p, k || cmd->nassigns ? " %s" : "%s", cmd->argv[k]);
+        }
+        for (struct redir *r = cmd->redirs; r; r = r->next) {
+            p += sprintf(p, *r->target ? " %s %s" : " %s", redir_op(r->type), r->target);
+        }
+    }
+    for (int b = 0; b < pl->nbranches; b++) {
+        p += sprintf(p, b ? " (" : " |> (");
+        p = put_text(p, &pl->branches[b]);
+        p += sprintf(p, ")");
+    }
+    return p;
+}
+
+static void build_text(struct job *j) {
+    if (j->text || !j->pl) return;
+
+    j->text = malloc(text_len(j->pl) + 1);
+    if (!j->text) return;
+    *put_text(j->text, j->pl) = '\0';
+    j->pl = NULL;
+}
+
+static void add_to_table(struct job *j) {
+    if (j->id) return;
+    build_text(j);
+
+    int slot = 0;
+    while (slot < table_size && table[slot]) slot++;
+    if (slot == table_size) {
+        int size = table_size ? table_size * 2 : 8;
+        table = realloc(table, size * sizeof(*table));
+        if (!table) {
+            perror("job table allocation failed");
+            exit(1);
+        }
+        memset(table + table_size, 0, (size - table_size) * sizeof(*table));
+        table_size = size;
+    }
+    table[slot] = j;
+    j->id = slot + 1;
+}
+
+void job_discard(struct job *j) {
+    for (int i = 0; i < j->nprocs; i++) {
+        if (j->procs[i].pidfd >= 0) close_pidfd(&j->procs[i]);
+    }
+    if (j->id) table[j->id - 1] = NULL;
+    free(j->text);
+    free(j->procs);
+    free(j);
+}
+
+// Put a freshly started job in the background
+void job_background(struct job *j) {
+    add_to_table(j);
+    if (job_control) printf("[%d] %d\n", j->id, (int)j->pgid);
+}
+
+// A finished job's status, or 124 after reporting that it timed out
+static int finished_status(struct job *j) {
+    if (!j->timed_out) return j->status;
+    build_text(j);
+    fprintf(stderr, "timed out: %s\n", j->text ? j->text : "");
+    return STATUS_TIMEOUT;
+}
+
+static int wait_foreground(struct job *j) {
+    uint64_t t0 = stat_clock();
+    current = j;
+    if (job_control) tcsetpgrp(STDIN_FILENO, j->pgid);
+
+    for (;;) {
+        update_job(j);
+        while (j->state == JOB_RUNNING) {
+            reap_jobs(deadline_wait(j));
+            check_deadline(j);
+        }
+        // Builtin stages are threads of the shell and cannot be suspended
+        if (j->state != JOB_STOPPED || !j->threads) break;
+        if (job_control) write(STDOUT_FILENO, "\n", 1);
+        kill(-j->pgid, SIGKILL);
+        kill(-j->pgid, SIGCONT);
+        reap_jobs(-1);
+    }
+
+    if (job_control) tcsetpgrp(STDIN_FILENO, shell_pgid);
+    current = NULL;
+    trace_span("wait", t0, NULL, 0);
+    stat_time(STAT_WAIT, t0);
+
+    if (j->state == JOB_STOPPED) {
+        add_to_table(j);
+        printf("\n[%d]+  Stopped\t\t%s\n", j->id, j->text ? j->text : "");
+        fflush(stdout);
+        return 128 + SIGTSTP;
+    }
+    // The prompt should not follow an interrupted job's ^C on the same line
+    if (job_control && j->status == 128 + SIGINT) write(STDOUT_FILENO, "\n", 1);
+    add_usage(&job_rusage, &j->usage);
+    int status = finished_status(j);
+    job_discard(j);
+    return status;
+}
+
+// Wait for a foreground job to finish or stop. Returns its exit status;
+// a stopped job moves to the job table.
+int job_wait(struct job *j) {
+    if (j->nprocs == 0) {
+        int status = j->status;
+        job_discard(j);
+        return status;
+    }
+    return wait_foreground(j);
+}
+
+int jobs_pending() {
+    for (int i = 0; i < table_size; i++) {
+        if (table[i]) return 1;
+    }
+    return 0;
+}
+
+// Report background jobs that finished since the last prompt. Scripts
+// keep finished jobs until a wait or jobs collects their status.
+void notify_jobs() {
+    reap_jobs(0);
+    if (!job_control) return;
+    for (int i = 0; i < table_size; i++) {
+        struct job *j = table[i];
+        if (j && j->state == JOB_DONE) {
+            printf("[%d]+  Done\t\t\t%s\n", j->id, j->text ? j->text : "");
+            job_discard(j);
+        }
+    }
+    fflush(stdout);
+}
+
+// Stopped jobs would never run again once the shell is gone
+void hangup_jobs() {
+    for (int i = 0; i < table_size; i++) {
+        struct job *j = table[i];
+        if (j && j->state == JOB_STOPPED) {
+            kill(-j->pgid, SIGHUP);
+            kill(-j->pgid, SIGCONT);
+        }
+    }
+}
+
+// === Job Builtins ===
+// %N, %+/%% (newest), %- (the one before), or a pid
+static struct job *find_job(const char *spec, int err, const char *who) {
+    struct job *newest = NULL, *previous = NULL;
+    for (int i = 0; i < table_size; i++) {
+        if (!table[i]) continue;
+        previous = newest;
+        newest = table[i];
+    }
+
+    struct job *j = NULL;
+    if (!spec || strcmp(spec, "%+") == 0 || strcmp(spec, "%%") == 0) {
+        j = newest;
+    } else if (strcmp(spec, "%-") == 0) {
+        j = previous;
+    } else if (spec[0] == '%') {
+        int id = atoi(spec + 1);
+        if (id > 0 && id <= table_size) j = table[id - 1];
+    } else {
+        pid_t pid = atoi(spec);
+        for (int i = 0; i < table_size && !j; i++) {
+            for (int k = 0; table[i] && k < table[i]->nprocs; k++) {
+                if (table[i]->procs[k].pid == pid) j = table[i];
+            }
+        }
+    }
+    if (!j) dprintf(err, "%s: %s: no such job\n", who, spec ? spec : "current");
+    return j;
+}
+
+int builtin_jobs(char **args, struct builtin_io *io) {
+    reap_jobs(0);
+    for (int i = 0; i < table_size; i++) {
+        struct job *j = table[i];
+        if (!j) continue;
+        const char *state = j->state == JOB_RUNNING ? "Running" :
+                            j->state == JOB_STOPPED ? "Stopped" : "Done";
+        dprintf(io->out, "[%d]  %-8s\t\t%s\n", j->id, state, j->text ? j->text : "");
+        if (j->state == JOB_DONE) job_discard(j);
+    }
+    return 0;
+}
+
+int builtin_fg(char **args, struct builtin_io *io) {
+    struct job *j = find_job(args[1], io->err, "fg");
+    if (!j) return 1;
+
+    dprintf(io->out, "%s\n", j->text ? j->text : "");
+    table[j->id - 1] = NULL;
+    j->id = 0;
+    if (j->state == JOB_STOPPED) {
+        kill(-j->pgid, SIGCONT);
+        for (int i = 0; i < j->nprocs; i++) {
+            if (j->procs[i].state == JOB_STOPPED) j->procs[i].state = JOB_RUNNING;
+        }
+        j->state = JOB_RUNNING;
+    }
+    return wait_foreground(j);
+}
+
+int builtin_bg(char **args, struct builtin_io *io) {
+    struct job *j = find_job(args[1], io->err, "bg");
+    if (!j) return 1;
+
+    if (j->state == JOB_STOPPED) {
+        kill(-j->pgid, SIGCONT);
+        for (int i = 0; i < j->nprocs; i++) {
+            if (j->procs[i].state == JOB_STOPPED) j->procs[i].state = JOB_RUNNING;
+        }
+        j->state = JOB_RUNNING;
+    }
+    dprintf(io->out, "[%d]+ %s &\n", j->id, j->text ? j->text : "");
+    return 0;
+}
+
+// wait [job...]: with no operands, wait for every running background job
+int builtin_wait(char **args, struct builtin_io *io) {
+    int status = 0;
+
+    if (!args[1]) {
+        for (;;) {
+            int running = 0;
+            for (int i = 0; i < table_size; i++) {
+                if (table[i] && table[i]->state == JOB_RUNNING) running = 1;
+            }
+            if (!running) break;
+            reap_jobs(-1);
+        }
+        for (int i = 0; i < table_size; i++) {
+            if (table[i] && table[i]->state == JOB_DONE) job_discard(table[i]);
+        }
+        return 0;
+    }
+
+    for (int i = 1; args[i]; i++) {
+        struct job *j = find_job(args[i], io->err, "wait");
+        if (!j) {
+            status = 127;
+            continue;
+        }
+        while (j->state == JOB_RUNNING) {
+            reap_jobs(deadline_wait(j));
+            check_deadline(j);
+        }
+        status = j->state == JOB_DONE ? finished_status(j) : 128 + SIGTSTP;
+        if (j->state == JOB_DONE) job_discard(j);
+    }
+    return status;
+}
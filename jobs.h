@@ -0,0 +1,68 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include "parse.h"
+#include "builtins.h"
+
+#define JOB_RUNNING 0
+#define JOB_STOPPED 1
+#define JOB_DONE 2
+
+// What a job killed by its timeout reports, as with timeout(1)
+#define STATUS_TIMEOUT 124
+
+struct job_proc {
+    pid_t pid;
+    int pidfd;          // -1 once reaped
+    int state;
+    uint64_t start;     // launch time and command name, when tracing
+    char name[32];
+};
+
+// A pipeline's processes. Foreground jobs live outside the job table
+// (id 0) until they stop or are started with '&'.
+struct job {
+    int id;
+    pid_t pgid;
+    int state;
+    int status;         // exit code of the last stage
+    int nprocs;
+    int procs_cap;
+    struct job_proc *procs;
+    pid_t last_pid;     // process whose status is the job's, or 0
+    int threads;        // has builtin-thread stages, so cannot be stopped
+    uint64_t deadline;  // CLOCK_MONOTONIC ms of the next timeout signal, or 0
+    int kill_after;     // ms from SIGTERM to SIGKILL
+    int timed_out;
+    struct rusage usage;    // of the processes reaped so far
+    char *text;
+    struct pipeline *pl;    // AST while in the foreground, for naming
+};
+
+extern int job_control;
+// Resources used by every finished foreground job's processes; ru_maxrss
+// is the largest of them
+extern struct rusage job_rusage;
+
+void init_jobs(int interactive);
+void reset_jobs_after_fork();
+struct job *job_create(struct pipeline *pl);
+int job_add_process(struct job *j, pid_t pid, const char *name);
+void job_set_timeout(struct job *j, double timeout, double kill_after);
+int job_wait(struct job *j);
+void job_background(struct job *j);
+void job_discard(struct job *j);
+int jobs_pending();
+void reap_jobs(int timeout_ms);
+void notify_jobs();
+void hangup_jobs();
+
+int builtin_jobs(char **args, struct builtin_io *io);
+int builtin_fg(char **args, struct builtin_io *io);
+int builtin_bg(char **args, struct builtin_io *io);
+int builtin_wait(char **args, struct builtin_io *io);
+
+#endif
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "limit.h"
+
+// === Resource Limits ===
+// 'limit [-t secs] [-k secs] [-c secs] [-m size] [-n count] [command]'.
+// With a command it is a prefix: run_pipeline strips it and runs the
+// rest of the pipeline under those limits. Without one it sets the
+// defaults every later pipeline runs under, so a line at the top of a
+// batch file bounds the whole batch.
+struct limits default_limits = {
+    0, LIMIT_KILL_AFTER, { RLIM_INFINITY, RLIM_INFINITY, RLIM_INFINITY }
+};
+
+static int parse_seconds(const char *s, double *v) {
+    char *end;
+    double d = s ? strtod(s, &end) : 0;
+    if (!s || !*s || *end || !isfinite(d) || d < 0) return -1;
+    *v = d;
+    return 0;
+}
+
+// A count, or a size with a K, M, G or T suffix; 'unlimited' for none
+static int parse_rlim(const char *s, rlim_t *v, int size) {
+    if (s && strcmp(s, "unlimited") == 0) {
+        *v = RLIM_INFINITY;
+        return 0;
+    }
+    char *end;
+    unsigned long long n = s && *s >= '0' && *s <= '9' ? strtoull(s, &end, 10) : 0;
+    if (!s || *s < '0' || *s > '9') return -1;
+
+    const char *units = "KMGT";
+    const char *u = size && *end ? strchr(units, *end) : NULL;
+    if (u) {
+        int shift = 10 * (u - units + 1);
+        if (n > ~0ull >> shift) return -1;
+        n <<= shift;
+        end++;
+    }
+    if (*end || n >= RLIM_INFINITY) return -1;
+    *v = n;
+    return 0;
+}
+
+// Read options from args[1] on into l. Returns the index of the command
+// word, 0 if there is none, or -1 for a bad option (reported on err
+// unless it is negative).
+int limit_command(char **args, struct limits *l, int err) {
+    int i = 1;
+    for (; args[i] && args[i][0] == '-'; i++) {
+        const char *a = args[i];
+        if (strcmp(a, "--") == 0) {
+            i++;
+            break;
+        }
+        const char *v = a[1] && a[2] ? a + 2 : args[++i];
+        int bad;
+        switch (a[1]) {
+        case 't': bad = parse_seconds(v, &l->timeout); break;
+        case 'k': bad = parse_seconds(v, &l->kill_after); break;
+        case 'c': bad = parse_rlim(v, &l->rl.cpu, 0); break;
+        case 'm': bad = parse_rlim(v, &l->rl.as, 1); break;
+        case 'n': bad = parse_rlim(v, &l->rl.nofile, 0); break;
+        default: bad = -1;
+        }
+        if (bad || !v) {
+            if (err >= 0) {
+                dprintf(err, "Usage: limit [-t secs] [-k secs] [-c secs] [-m size] [-n count] "
+                             "[command]\n");
+            }
+            return -1;
+        }
+    }
+    return args[i] ? i : 0;
+}
+
+// The limits to hand to spawn_io, or NULL if there are none (so the
+// child can be launched with posix_spawn)
+const struct spawn_limits *child_limits(const struct limits *l) {
+    const struct spawn_limits *rl = &l->rl;
+    int none = rl->cpu == RLIM_INFINITY && rl->as == RLIM_INFINITY && rl->nofile == RLIM_INFINITY;
+    return none ? NULL : rl;
+}
+
+static void print_rlim(int fd, const char *opt, rlim_t v) {
+    if (v == RLIM_INFINITY) dprintf(fd, " %s unlimited", opt);
+    else dprintf(fd, " %s %llu", opt, (unsigned long long)v);
+}
+
+// Reached only without a command: sets or, with no options, prints the
+// defaults. A prefix anywhere but the start of a pipeline is an error.
+int builtin_limit(char **args, struct builtin_io *io) {
+    struct limits l = default_limits;
+    int cmd = limit_command(args, &l, io->err);
+    if (cmd < 0) return 2;
+    if (cmd > 0) {
+        dprintf(io->err, "limit: only a pipeline's first command can be limited\n");
+        return 2;
+    }
+
+    if (!args[1]) {
+        dprintf(io->out, "limit -t %g -k %g", l.timeout, l.kill_after);
+        print_rlim(io->out, "-c", l.rl.cpu);
+        print_rlim(io->out, "-m", l.rl.as);
+        print_rlim(io->out, "-n", l.rl.nofile);
+        dprintf(io->out, "\n");
+    }
+    default_limits = l;
+    return 0;
+}
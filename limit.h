@@ -0,0 +1,26 @@
+#ifndef LIMIT_H
+#define LIMIT_H
+
+#include "builtins.h"
+#include "spawn.h"
+
+// Seconds between SIGTERM and SIGKILL when a timeout expires, unless
+// 'limit -k' says otherwise
+#define LIMIT_KILL_AFTER 2.0
+
+// What a pipeline runs under: a wall-clock timeout (0 for none) and the
+// resource limits of every process it starts
+struct limits {
+    double timeout;
+    double kill_after;
+    struct spawn_limits rl;
+};
+
+// Set by 'limit' without a command; apply to every later pipeline
+extern struct limits default_limits;
+
+int limit_command(char **args, struct limits *l, int err);
+const struct spawn_limits *child_limits(const struct limits *l);
+int builtin_limit(char **args, struct builtin_io *io);
+
+#endif
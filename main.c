@@ -1,31 +1,118 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <getopt.h>
 #include "shell.h"
 #include "path.h"
+#include "env.h"
+#include "spawn.h"
+#include "batch.h"
+#include "script.h"
+#include "jobs.h"
+#include "trace.h"
+#include "execute.h"
+#include "serve.h"
+#include "incremental.h"
+#include "stats.h"
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-e] [-I] [-j jobs] [-P | -F] [-S] [batch_file]\n"
+                    "       %s [-e] -c command\n"
+                    "       %s --serve socket\n", prog, prog, prog);
+    exit(1);
+}
 
 int main(int argc, char *argv[]) {
-    FILE *input = stdin;
+    int input = STDIN_FILENO;
     int interactive = 1;
+    int max_jobs = 1;
+    int compiled = 0, rebuild = 0, show_stats = 0;
+    int status = 0;
+    const char *command = NULL, *serve_path = NULL;
+    int opt;
+
+    static const struct option long_opts[] = {
+        { "serve", required_argument, NULL, 'L' },
+        { NULL, 0, NULL, 0 },
+    };
+    while ((opt = getopt_long(argc, argv, "eIj:PFSc:", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'e':
+            errexit = 1;
+            break;
+        case 'I':
+            incremental = 1;
+            break;
+        case 'c':
+            command = optarg;
+            break;
+        case 'L':
+            serve_path = optarg;
+            break;
+        case 'j':
+            max_jobs = atoi(optarg);
+            if (max_jobs < 1) usage(argv[0]);
+            break;
+        case 'F':
+            rebuild = 1;
+            // fall through
+        case 'P':
+            compiled = 1;
+            break;
+        case 'S':
+            show_stats = 1;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
 
-    if (argc == 2) {
-        input = fopen(argv[1], "r");
-        if (!input) {
+    if (command || serve_path) {
+        if (optind != argc || (command && serve_path) || max_jobs > 1 || compiled) usage(argv[0]);
+        interactive = 0;
+    } else if (optind == argc - 1) {
+        input = open(argv[optind], O_RDONLY | O_CLOEXEC);
+        if (input < 0) {
             perror("Batch file open error");
             exit(1);
         }
         interactive = 0;
-    } else if (argc > 2) {
-        fprintf(stderr, "Usage: %s [batch_file]\n", argv[0]);
+    } else if (optind < argc - 1) {
+        usage(argv[0]);
+    }
+
+    if ((max_jobs > 1 || compiled) && interactive) {
+        fprintf(stderr, "-j, -P and -F require a batch file\n");
         exit(1);
     }
 
     signal(SIGINT, sigint_handler);
     signal(SIGTSTP, sigint_handler);
+    // Builtin pipeline stages run as threads and see EPIPE instead
+    signal(SIGPIPE, SIG_IGN);
 
+    init_env();
     init_path();
-    run_shell(input, interactive);
+    init_spawn();
+    init_jobs(interactive);
+    init_trace();
+    init_stats();
+    if (serve_path) {
+        status = run_server(serve_path);
+    } else if (command) {
+        status = parse_and_execute(command, strlen(command));
+    } else if (compiled) {
+        status = run_compiled_script(argv[optind], max_jobs, rebuild);
+        if (show_stats) print_script_stats();
+    } else if (max_jobs > 1) {
+        status = run_batch_parallel(input, max_jobs);
+    } else {
+        status = run_shell(input, interactive);
+    }
 
-    if (input != stdin) fclose(input);
-    return 0;
+    if (input != STDIN_FILENO) close(input);
+    return status;
 }
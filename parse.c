@@ -0,0 +1,635 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "parse.h"
+
+#define TOK_END 0
+#define TOK_WORD 1
+#define TOK_SEMI 2
+#define TOK_PIPE 3
+#define TOK_LT 4
+#define TOK_REDIR 5     // any redirection but '<', type in lexer.redir
+#define TOK_ERROR 6
+#define TOK_AMP 7
+#define TOK_AND 8
+#define TOK_OR 9
+#define TOK_FANOUT 10   // '|>'
+#define TOK_LPAREN 11   // '(' and ')' only delimit the groups after '|>'
+#define TOK_RPAREN 12
+
+struct lexer {
+    const char *s;
+    const char *end;
+    int redir;      // type of the last TOK_REDIR
+    int groups;     // after '|>': parentheses are tokens
+};
+
+static const char *redir_ops[] = { "<", ">", ">>", "2>", "2>>", "&>", "&>>", "2>&1", ">&2" };
+
+const char *redir_op(int type) {
+    return redir_ops[type];
+}
+
+int redir_appends(int type) {
+    return type == REDIR_APPEND || type == REDIR_ERR_APPEND || type == REDIR_ALL_APPEND;
+}
+
+// The fd a redirection of this type sets: 0, 1 or 2
+int redir_fd(int type) {
+    if (type == REDIR_IN) return 0;
+    return type == REDIR_ERR || type == REDIR_ERR_APPEND || type == REDIR_ERR_TO_OUT ? 2 : 1;
+}
+
+static void *grow(void *buf, int *cap, size_t elem) {
+    *cap = *cap ? *cap * 2 : 16;
+    buf = realloc(buf, *cap * elem);
+    if (!buf) {
+        perror("parser allocation failed");
+        exit(1);
+    }
+    return buf;
+}
+
+static void put_char(struct parser *p, size_t *len, char c) {
+    if (*len + 1 >= p->word_cap) {
+        p->word_cap = p->word_cap ? p->word_cap * 2 : 256;
+        p->word = realloc(p->word, p->word_cap);
+        if (!p->word) {
+            perror("parser allocation failed");
+            exit(1);
+        }
+    }
+    p->word[(*len)++] = c;
+}
+
+// A literal byte of a word: marker bytes are escaped so a word with a
+// substitution can tell them apart
+static void put_literal(struct parser *p, size_t *len, char c) {
+    if (c >= SUBST_BEGIN && c <= WORD_ESCAPE) {
+        put_char(p, len, WORD_ESCAPE);
+        p->escaped = 1;
+    }
+    put_char(p, len, c);
+}
+
+// A quoted byte of a word, which also stays literal when the word is
+// matched as a glob (or, for '=', keeps the word from being an assignment)
+static void put_quoted(struct parser *p, size_t *len, char c) {
+    if (c == '*' || c == '?' || c == '[' || c == ']' || c == '=') {
+        put_char(p, len, WORD_ESCAPE);
+        p->escaped = 1;
+    }
+    put_literal(p, len, c);
+}
+
+// $(...): copy the command text up to the matching ')' between markers.
+// Quotes, escapes and backquotes inside are skipped over, not unquoted;
+// the text is parsed again when it runs.
+static int lex_subst(struct parser *p, struct lexer *lx, size_t *len, char marker) {
+    const char *start = lx->s;
+    int depth = 1;
+
+    while (lx->s < lx->end) {
+        char c = *lx->s++;
+        if (c == '\\') {
+            if (lx->s < lx->end) lx->s++;
+        } else if (c == '\'') {
+            const char *close = memchr(lx->s, '\'', lx->end - lx->s);
+            if (!close) break;
+            lx->s = close + 1;
+        } else if (c == '"' || c == '`') {
+            while (lx->s < lx->end && *lx->s != c) {
+                if (*lx->s == '\\' && lx->s + 1 < lx->end) lx->s++;
+                lx->s++;
+            }
+            if (lx->s == lx->end) break;
+            lx->s++;
+        } else if (c == '(') {
+            depth++;
+        } else if (c == ')' && --depth == 0) {
+            put_char(p, len, marker);
+            for (const char *q = start; q < lx->s - 1; q++) put_literal(p, len, *q);
+            put_char(p, len, EXPAND_END);
+            p->expand = 1;
+            return 0;
+        }
+    }
+    p->error = "unterminated command substitution";
+    return -1;
+}
+
+// `...`: backslash quotes only $, ` and \ (and " inside double quotes)
+static int lex_backquote(struct parser *p, struct lexer *lx, size_t *len, char marker) {
+    put_char(p, len, marker);
+    while (lx->s < lx->end && *lx->s != '`') {
+        char c = *lx->s++;
+        if (c == '\\' && lx->s < lx->end &&
+            (*lx->s == '$' || *lx->s == '`' || *lx->s == '\\' ||
+             (*lx->s == '"' && marker == SUBST_QUOTED))) {
+            c = *lx->s++;
+        }
+        put_literal(p, len, c);
+    }
+    if (lx->s == lx->end) {
+        p->error = "unterminated command substitution";
+        return -1;
+    }
+    lx->s++;
+    put_char(p, len, EXPAND_END);
+    p->expand = 1;
+    return 0;
+}
+
+// $?, $NAME: the name between markers, looked up when the command runs
+static void put_param(struct parser *p, size_t *len, char marker, const char *name, size_t n) {
+    put_char(p, len, marker);
+    for (size_t i = 0; i < n; i++) put_char(p, len, name[i]);
+    put_char(p, len, EXPAND_END);
+    p->expand = 1;
+}
+
+static int is_name_char(char c, int first) {
+    return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (!first && c >= '0' && c <= '9');
+}
+
+// After a '$': $?, $NAME or ${NAME}. Returns 0 if none follows (the '$'
+// is then literal), or -1 for a malformed ${...}.
+static int lex_param(struct parser *p, struct lexer *lx, size_t *len, char marker) {
+    if (lx->s == lx->end) return 0;
+    if (*lx->s == '?') {
+        put_param(p, len, marker, lx->s++, 1);
+        return 1;
+    }
+
+    int braced = *lx->s == '{';
+    const char *name = lx->s + braced, *q = name;
+    while (q < lx->end && is_name_char(*q, q == name)) q++;
+    if (braced && (q == name || q == lx->end || *q != '}')) {
+        p->error = "bad substitution";
+        return -1;
+    }
+    if (q == name) return 0;
+    put_param(p, len, marker, name, q - name);
+    lx->s = q + braced;
+    return 1;
+}
+
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int is_special(char c) {
+    return c == ';' || c == '|' || c == '<' || c == '>' || c == '&';
+}
+
+// Scan an output redirection starting skip bytes before its '>'. '>>'
+// gives the append type, and '>&N' duplicates fd N.
+static int lex_redir(struct parser *p, struct lexer *lx, int skip, int type, int append) {
+    int fd = skip && lx->s[0] == '2' ? 2 : 1;
+    lx->s += skip + 1;
+
+    if (lx->s < lx->end && *lx->s == '>') {
+        lx->s++;
+        lx->redir = append;
+    } else if (lx->s < lx->end && *lx->s == '&' && type != REDIR_ALL) {
+        lx->s++;
+        int target = lx->s < lx->end ? *lx->s++ : 0;
+        if (fd == 2 && target == '1') lx->redir = REDIR_ERR_TO_OUT;
+        else if (fd == 1 && target == '2') lx->redir = REDIR_OUT_TO_ERR;
+        else {
+            p->error = "unsupported redirection";
+            return TOK_ERROR;
+        }
+    } else {
+        lx->redir = type;
+    }
+    return TOK_REDIR;
+}
+
+// Scan one token. Words are unquoted into p->word (length in *len):
+// '...' is literal, "..." honours \\ \" \$ and \`, and a bare backslash
+// escapes the next character. $(...), `...`, $? and $NAME are expanded
+// when the command runs, also inside double quotes.
+static int next_token(struct parser *p, struct lexer *lx, size_t *len) {
+    while (lx->s < lx->end && is_space(*lx->s)) lx->s++;
+    if (lx->s == lx->end) return TOK_END;
+
+    switch (*lx->s) {
+    case ';': lx->s++; return TOK_SEMI;
+    case '&':
+        lx->s++;
+        if (lx->s < lx->end && *lx->s == '&') {
+            lx->s++;
+            return TOK_AND;
+        }
+        if (lx->s < lx->end && *lx->s == '>') {
+            return lex_redir(p, lx, 0, REDIR_ALL, REDIR_ALL_APPEND);
+        }
+        return TOK_AMP;
+    case '|':
+        lx->s++;
+        if (lx->s < lx->end && *lx->s == '|') {
+            lx->s++;
+            return TOK_OR;
+        }
+        if (lx->s < lx->end && *lx->s == '>') {
+            lx->s++;
+            lx->groups = 1;
+            return TOK_FANOUT;
+        }
+        return TOK_PIPE;
+    case '(':
+    case ')':
+        if (!lx->groups) break;
+        return *lx->s++ == '(' ? TOK_LPAREN : TOK_RPAREN;
+    case '<': lx->s++; return TOK_LT;
+    case '>': return lex_redir(p, lx, 0, REDIR_OUT, REDIR_APPEND);
+    case '1':
+    case '2':
+        // A lone fd number written against '>' belongs to the redirection
+        if (lx->s + 1 < lx->end && lx->s[1] == '>') {
+            return lx->s[0] == '1' ? lex_redir(p, lx, 1, REDIR_OUT, REDIR_APPEND)
+                                   : lex_redir(p, lx, 1, REDIR_ERR, REDIR_ERR_APPEND);
+        }
+        break;
+    }
+
+    *len = 0;
+    int r;
+    while (lx->s < lx->end && !is_space(*lx->s) && !is_special(*lx->s) &&
+           !(lx->groups && (*lx->s == '(' || *lx->s == ')'))) {
+        char c = *lx->s++;
+        if (c == '\\') {
+            if (lx->s < lx->end) put_quoted(p, len, *lx->s++);
+        } else if (c == '\'') {
+            const char *close = memchr(lx->s, '\'', lx->end - lx->s);
+            if (!close) {
+                p->error = "unterminated quote";
+                return TOK_ERROR;
+            }
+            while (lx->s < close) put_quoted(p, len, *lx->s++);
+            lx->s++;
+        } else if (c == '$' && lx->s < lx->end && *lx->s == '(') {
+            lx->s++;
+            if (lex_subst(p, lx, len, SUBST_BEGIN) < 0) return TOK_ERROR;
+        } else if (c == '$' && (r = lex_param(p, lx, len, PARAM_BEGIN)) != 0) {
+            if (r < 0) return TOK_ERROR;
+        } else if (c == '`') {
+            if (lex_backquote(p, lx, len, SUBST_BEGIN) < 0) return TOK_ERROR;
+        } else if (c == '"') {
+            while (lx->s < lx->end && *lx->s != '"') {
+                c = *lx->s++;
+                if (c == '$' && lx->s < lx->end && *lx->s == '(') {
+                    lx->s++;
+                    if (lex_subst(p, lx, len, SUBST_QUOTED) < 0) return TOK_ERROR;
+                    continue;
+                }
+                if (c == '`') {
+                    if (lex_backquote(p, lx, len, SUBST_QUOTED) < 0) return TOK_ERROR;
+                    continue;
+                }
+                if (c == '$' && (r = lex_param(p, lx, len, PARAM_QUOTED)) != 0) {
+                    if (r < 0) return TOK_ERROR;
+                    continue;
+                }
+                if (c == '\\' && lx->s < lx->end &&
+                    (*lx->s == '"' || *lx->s == '\\' || *lx->s == '$' || *lx->s == '`')) {
+                    c = *lx->s++;
+                }
+                put_quoted(p, len, c);
+            }
+            if (lx->s == lx->end) {
+                p->error = "unterminated quote";
+                return TOK_ERROR;
+            }
+            lx->s++;
+        } else {
+            put_literal(p, len, c);
+        }
+    }
+    return TOK_WORD;
+}
+
+// Whether the word just scanned is kw, written without quotes
+static int is_keyword(struct parser *p, struct lexer *lx, size_t wlen, const char *kw) {
+    size_t n = strlen(kw);
+    return wlen == n && memcmp(p->word, kw, n) == 0 && memcmp(lx->s - n, kw, n) == 0;
+}
+
+// Whether the word just scanned is NAME=value with an unquoted '='
+static int is_assignment(const char *w, size_t len) {
+    size_t i = 0;
+    while (i < len && is_name_char(w[i], i == 0)) i++;
+    return i > 0 && i < len && w[i] == '=';
+}
+
+// Length of the bracket expression at w[0] == '[', or 0 if it is not
+// closed and so stands for itself. A ']' right after '[' or '[!' is a
+// member, and so is a class such as [:digit:].
+size_t bracket_len(const char *w, size_t len) {
+    size_t i = 1;
+    if (i < len && (w[i] == '!' || w[i] == '^')) i++;
+    if (i < len && w[i] == ']') i++;
+    for (; i < len; i++) {
+        if (w[i] == WORD_ESCAPE) {
+            i++;
+        } else if (w[i] == '[' && i + 1 < len && w[i + 1] == ':') {
+            size_t k = i + 2;
+            while (k + 1 < len && !(w[k] == ':' && w[k + 1] == ']')) k++;
+            if (k + 1 >= len) return 0;
+            i = k + 1;
+        } else if (w[i] == ']') {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// Whether w has an unquoted '*', '?' or bracket expression outside its
+// expansions, and so is matched against file names
+int word_has_glob(const char *w, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        char c = w[i];
+        if (c == WORD_ESCAPE) {
+            i++;
+        } else if (c >= SUBST_BEGIN && c <= PARAM_QUOTED) {
+            while (i < len && w[i] != EXPAND_END) i += w[i] == WORD_ESCAPE ? 2 : 1;
+        } else if (c == '*' || c == '?' || (c == '[' && bracket_len(w + i, len - i))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Drop WORD_ESCAPE bytes from a word of a command without substitutions
+static void unescape(char *w) {
+    char *out = w;
+    for (; *w; w++) {
+        if (*w == WORD_ESCAPE && w[1]) w++;
+        *out++ = *w;
+    }
+    *out = '\0';
+}
+
+// Parse a line (not necessarily NUL-terminated) in one pass. Returns NULL
+// on a syntax error, described by p->error. Empty commands between ';'
+// are dropped.
+//
+// 'producer |> (c1) (c2 | c3)' ends a pipeline's own commands and adds
+// one branch per parenthesized group. The commands of all groups are
+// collected after the producer's in p->cmds, with p->branch_ends marking
+// where each group stops.
+struct sequence *parse_line(struct parser *p, const char *line, size_t len) {
+    struct lexer lx = { line, line + len };
+    int nwords = 0, ncmds = 0, npipes = 0, timed = 0, cached = 0, run_if = RUN_ALWAYS;
+    int nassigns = 0;    // the first nassigns words are assignments
+    int fanout = 0, main_cmds = 0, nbranches = 0;    // fanout: 1 between groups, 2 inside one
+    struct redir *redirs = NULL, **redir_tail = &redirs;
+    size_t wlen = 0;
+
+    arena_reset(&p->arena);
+    if (!p->word) put_char(p, &wlen, '\0');
+    p->expand = p->escaped = 0;
+
+    for (;;) {
+        int tok = next_token(p, &lx, &wlen);
+
+        if (tok == TOK_ERROR) return NULL;
+
+        if (fanout == 1 && (tok == TOK_WORD || tok == TOK_LT || tok == TOK_REDIR ||
+                            tok == TOK_PIPE || tok == TOK_RPAREN)) {
+            p->error = "expected '(' after '|>'";
+            return NULL;
+        }
+
+        if (tok == TOK_WORD) {
+            // An unquoted 'time' or 'cached' opening a pipeline is a
+            // keyword, not argv[0]
+            if (nwords == 0 && ncmds == 0 && !redirs) {
+                if (!timed && is_keyword(p, &lx, wlen, "time")) {
+                    timed = 1;
+                    continue;
+                }
+                if (!cached && is_keyword(p, &lx, wlen, "cached")) {
+                    cached = 1;
+                    continue;
+                }
+            }
+            int assign = nwords == nassigns && is_assignment(p->word, wlen);
+            if (!assign && word_has_glob(p->word, wlen)) p->expand = 1;
+            if (nwords + 1 >= p->words_cap) {
+                p->words = grow(p->words, &p->words_cap, sizeof(char *));
+            }
+            p->words[nwords++] = arena_strndup(&p->arena, p->word, wlen);
+            nassigns += assign;
+            continue;
+        }
+
+        if (tok == TOK_LT || tok == TOK_REDIR) {
+            struct redir *r = arena_alloc(&p->arena, sizeof(*r));
+            r->type = tok == TOK_LT ? REDIR_IN : lx.redir;
+            if (r->type == REDIR_ERR_TO_OUT || r->type == REDIR_OUT_TO_ERR) {
+                r->target = arena_strndup(&p->arena, "", 0);
+            } else if (next_token(p, &lx, &wlen) != TOK_WORD) {
+                p->error = "missing redirection target";
+                return NULL;
+            } else {
+                r->target = arena_strndup(&p->arena, p->word, wlen);
+            }
+            r->next = NULL;
+            *redir_tail = r;
+            redir_tail = &r->next;
+            continue;
+        }
+
+        if (tok == TOK_LPAREN) {
+            if (fanout != 1) {
+                p->error = "unexpected '('";
+                return NULL;
+            }
+            fanout = 2;
+            continue;
+        }
+        if (tok == TOK_FANOUT && fanout) {
+            p->error = "nested '|>' is not supported";
+            return NULL;
+        }
+        if (tok == TOK_RPAREN && fanout != 2) {
+            p->error = "unexpected ')'";
+            return NULL;
+        }
+        if (fanout == 2 && tok != TOK_PIPE && tok != TOK_RPAREN) {
+            p->error = "unterminated '('";
+            return NULL;
+        }
+
+        // '|', '|>', ')', ';', '&', '&&', '||' or end of line: close the
+        // current command, unless a group was just closed
+        if (fanout == 1) {
+            if (nbranches == 0) {
+                p->error = "missing command after '|>'";
+                return NULL;
+            }
+        } else if (nwords == 0 && !redirs) {
+            if (tok == TOK_PIPE || tok == TOK_FANOUT || tok == TOK_RPAREN || ncmds > 0) {
+                p->error = "empty command in pipeline";
+                return NULL;
+            }
+            if (tok == TOK_AMP || tok == TOK_AND || tok == TOK_OR) {
+                p->error = tok == TOK_AMP ? "missing command before '&'" :
+                           tok == TOK_AND ? "missing command before '&&'" :
+                           "missing command before '||'";
+                return NULL;
+            }
+            if (run_if != RUN_ALWAYS) {
+                p->error = run_if == RUN_IF_OK ? "missing command after '&&'" :
+                           "missing command after '||'";
+                return NULL;
+            }
+        } else {
+            if (ncmds >= p->cmds_cap) p->cmds = grow(p->cmds, &p->cmds_cap, sizeof(struct command));
+            struct command *cmd = &p->cmds[ncmds++];
+            cmd->nassigns = nassigns;
+            cmd->assigns = arena_alloc(&p->arena, nassigns * sizeof(char *));
+            memcpy(cmd->assigns, p->words, nassigns * sizeof(char *));
+            cmd->argc = nwords - nassigns;
+            cmd->argv = arena_alloc(&p->arena, (cmd->argc + 1) * sizeof(char *));
+            memcpy(cmd->argv, p->words + nassigns, cmd->argc * sizeof(char *));
+            cmd->argv[cmd->argc] = NULL;
+            cmd->redirs = redirs;
+            cmd->expand = p->expand;
+            if (!p->expand && p->escaped) {
+                for (int k = 0; k < nwords; k++) unescape(p->words[k]);
+                for (struct redir *r = redirs; r; r = r->next) unescape(r->target);
+            }
+            p->expand = p->escaped = 0;
+            nwords = nassigns = 0;
+            redirs = NULL;
+            redir_tail = &redirs;
+        }
+        if (tok == TOK_PIPE) continue;
+        if (tok == TOK_FANOUT) {
+            main_cmds = ncmds;
+            fanout = 1;
+            continue;
+        }
+        if (tok == TOK_RPAREN) {
+            if (nbranches >= p->branches_cap) {
+                p->branch_ends = grow(p->branch_ends, &p->branches_cap, sizeof(int));
+            }
+            p->branch_ends[nbranches++] = ncmds;
+            fanout = 1;
+            continue;
+        }
+
+        if (ncmds > 0) {
+            if (npipes >= p->pipes_cap) {
+                p->pipes = grow(p->pipes, &p->pipes_cap, sizeof(struct pipeline));
+            }
+            struct pipeline *pl = &p->pipes[npipes++];
+            pl->ncmds = fanout ? main_cmds : ncmds;
+            pl->background = tok == TOK_AMP;
+            pl->timed = timed;
+            pl->run_if = run_if;
+            pl->cached = cached;
+            pl->cmds = arena_alloc(&p->arena, ncmds * sizeof(struct command));
+            memcpy(pl->cmds, p->cmds, ncmds * sizeof(struct command));
+            pl->nbranches = nbranches;
+            pl->branches = arena_alloc(&p->arena, nbranches * sizeof(struct pipeline));
+            for (int b = 0, first = main_cmds; b < nbranches; first = p->branch_ends[b++]) {
+                struct pipeline *br = &pl->branches[b];
+                memset(br, 0, sizeof(*br));
+                br->ncmds = p->branch_ends[b] - first;
+                br->cmds = pl->cmds + first;
+            }
+            ncmds = 0;
+        }
+        timed = cached = fanout = nbranches = lx.groups = 0;
+        run_if = tok == TOK_AND ? RUN_IF_OK : tok == TOK_OR ? RUN_IF_FAILED : RUN_ALWAYS;
+        if (tok == TOK_END) break;
+    }
+
+    struct sequence *seq = arena_alloc(&p->arena, sizeof(*seq));
+    seq->npipes = npipes;
+    seq->pipes = arena_alloc(&p->arena, npipes * sizeof(struct pipeline));
+    memcpy(seq->pipes, p->pipes, npipes * sizeof(struct pipeline));
+    return seq;
+}
+
+int pipeline_expands(const struct pipeline *pl) {
+    for (int i = 0; i < pl->ncmds; i++) {
+        if (pl->cmds[i].expand) return 1;
+    }
+    for (int b = 0; b < pl->nbranches; b++) {
+        if (pipeline_expands(&pl->branches[b])) return 1;
+    }
+    return 0;
+}
+
+static void copy_commands(struct arena *a, struct pipeline *pl, const struct pipeline *spl) {
+    pl->ncmds = spl->ncmds;
+    pl->cmds = arena_alloc(a, spl->ncmds * sizeof(struct command));
+    for (int j = 0; j < spl->ncmds; j++) {
+        const struct command *scmd = &spl->cmds[j];
+        struct command *cmd = &pl->cmds[j];
+        cmd->argc = scmd->argc;
+        cmd->expand = scmd->expand;
+        cmd->argv = arena_alloc(a, (scmd->argc + 1) * sizeof(char *));
+        for (int k = 0; k < scmd->argc; k++) {
+            cmd->argv[k] = arena_strndup(a, scmd->argv[k], strlen(scmd->argv[k]));
+        }
+        cmd->argv[scmd->argc] = NULL;
+        cmd->nassigns = scmd->nassigns;
+        cmd->assigns = arena_alloc(a, scmd->nassigns * sizeof(char *));
+        for (int k = 0; k < scmd->nassigns; k++) {
+            cmd->assigns[k] = arena_strndup(a, scmd->assigns[k], strlen(scmd->assigns[k]));
+        }
+
+        struct redir **tail = &cmd->redirs;
+        for (struct redir *sr = scmd->redirs; sr; sr = sr->next) {
+            struct redir *r = arena_alloc(a, sizeof(*r));
+            r->type = sr->type;
+            r->target = arena_strndup(a, sr->target, strlen(sr->target));
+            *tail = r;
+            tail = &r->next;
+        }
+        *tail = NULL;
+    }
+
+    pl->nbranches = spl->nbranches;
+    pl->branches = arena_alloc(a, spl->nbranches * sizeof(struct pipeline));
+    for (int b = 0; b < spl->nbranches; b++) {
+        memset(&pl->branches[b], 0, sizeof(struct pipeline));
+        copy_commands(a, &pl->branches[b], &spl->branches[b]);
+    }
+}
+
+// Deep-copy a parsed line into another arena so it outlives the parser's
+// next parse_line()
+struct sequence *copy_sequence(struct arena *a, const struct sequence *src) {
+    struct sequence *seq = arena_alloc(a, sizeof(*seq));
+    seq->npipes = src->npipes;
+    seq->pipes = arena_alloc(a, src->npipes * sizeof(struct pipeline));
+
+    for (int i = 0; i < src->npipes; i++) {
+        const struct pipeline *spl = &src->pipes[i];
+        struct pipeline *pl = &seq->pipes[i];
+        pl->background = spl->background;
+        pl->timed = spl->timed;
+        pl->run_if = spl->run_if;
+        pl->cached = spl->cached;
+        copy_commands(a, pl, spl);
+    }
+    return seq;
+}
+
+void parser_free(struct parser *p) {
+    arena_free(&p->arena);
+    free(p->word);
+    free(p->words);
+    free(p->cmds);
+    free(p->pipes);
+    free(p->branch_ends);
+    memset(p, 0, sizeof(*p));
+}
@@ -0,0 +1,108 @@
+#ifndef PARSE_H
+#define PARSE_H
+
+#include <stddef.h>
+#include "arena.h"
+
+// Redirections, applied left to right. The two duplications have an
+// empty target.
+#define REDIR_IN 0              // <
+#define REDIR_OUT 1             // >, 1>
+#define REDIR_APPEND 2          // >>, 1>>
+#define REDIR_ERR 3             // 2>
+#define REDIR_ERR_APPEND 4      // 2>>
+#define REDIR_ALL 5             // &>
+#define REDIR_ALL_APPEND 6      // &>>
+#define REDIR_ERR_TO_OUT 7      // 2>&1
+#define REDIR_OUT_TO_ERR 8      // >&2, 1>&2
+
+// === Command AST ===
+// A line parses into a sequence of pipelines, each a list of commands
+// joined by '|' (optionally fanning out with '|> (...) (...)') and ended
+// by ';', '&' (run in the background), '&&' or '||' (the next pipeline
+// runs only if this one succeeded/failed). All
+// nodes and strings live in the parser's arena and stay valid until the
+// next parse_line() on that parser.
+//
+// Words of a command with expand set may hold expansions: a command
+// substitution's text between SUBST_BEGIN and EXPAND_END, or a parameter
+// name between PARAM_BEGIN and EXPAND_END (the _QUOTED forms appear inside
+// double quotes). In such words WORD_ESCAPE precedes any literal byte that
+// would read as a marker, and any quoted '*', '?', '[' or ']', which would
+// otherwise be matched against file names. Other words are plain strings.
+#define SUBST_BEGIN '\001'
+#define SUBST_QUOTED '\002'
+#define PARAM_BEGIN '\003'
+#define PARAM_QUOTED '\004'
+#define EXPAND_END '\005'
+#define WORD_ESCAPE '\006'
+
+// When a pipeline runs, given the status of the one before it
+#define RUN_ALWAYS 0        // after ';', '&' or at the start of the line
+#define RUN_IF_OK 1         // after '&&'
+#define RUN_IF_FAILED 2     // after '||'
+
+struct redir {
+    int type;
+    char *target;
+    struct redir *next;
+};
+
+// Leading NAME=value words are assignments: they set variables for the
+// command, or in the shell if there is no command
+struct command {
+    int argc;
+    int expand;         // words need expansion before the command runs
+    char **argv;        // NULL-terminated
+    struct redir *redirs;
+    int nassigns;
+    char **assigns;     // "NAME=value" words
+};
+
+// After '|>', the output of the last command is copied to every branch,
+// itself a pipeline of commands (only ncmds, cmds are set in branches)
+struct pipeline {
+    int ncmds;
+    int background;
+    int timed;          // prefixed by the 'time' keyword
+    int run_if;
+    int cached;         // prefixed by 'cached': skipped when up to date
+    struct command *cmds;
+    int nbranches;
+    struct pipeline *branches;
+};
+
+struct sequence {
+    int npipes;
+    struct pipeline *pipes;
+};
+
+// Reusable parser state; a zero-initialized parser is ready to use
+struct parser {
+    struct arena arena;
+    char *word;
+    size_t word_cap;
+    char **words;
+    int words_cap;
+    struct command *cmds;
+    int cmds_cap;
+    struct pipeline *pipes;
+    int pipes_cap;
+    int *branch_ends;
+    int branches_cap;
+    int expand;         // the command being parsed has a substitution
+    int escaped;        // ... or a word with WORD_ESCAPE bytes
+    const char *error;
+};
+
+struct sequence *parse_line(struct parser *p, const char *line, size_t len);
+const char *redir_op(int type);
+int redir_appends(int type);
+int redir_fd(int type);
+int pipeline_expands(const struct pipeline *pl);
+int word_has_glob(const char *w, size_t len);
+size_t bracket_len(const char *w, size_t len);
+struct sequence *copy_sequence(struct arena *a, const struct sequence *src);
+void parser_free(struct parser *p);
+
+#endif
@@ -2,16 +2,159 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
 #include "path.h"
+#include "env.h"
+#include "stats.h"
 
 char *path_list[MAX_PATHS];
 int path_count = 0;
 
-void init_path() {
-    char *env_path = getenv("PATH");
-    if (!env_path) return;
+// === Executable Lookup Cache ===
+// Maps command name -> resolved path. A NULL path is a negative entry
+// for a command that is not on PATH. The whole table is dropped when
+// PATH is edited or when any PATH directory's mtime changes.
+struct hash_entry {
+    char *name;
+    char *path;
+    unsigned hits;
+};
+
+static struct hash_entry *hash_table = NULL;
+static int hash_size = 0;
+static int hash_used = 0;
+
+static struct timespec dir_mtime[MAX_PATHS];
+static time_t last_check = 0;
+
+static unsigned hash_name(const char *s) {
+    unsigned h = 2166136261u;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void snapshot_dirs() {
+    struct stat st;
+    for (int i = 0; i < path_count; i++) {
+        if (stat(path_list[i], &st) == 0) dir_mtime[i] = st.st_mtim;
+        else memset(&dir_mtime[i], 0, sizeof(dir_mtime[i]));
+    }
+}
+
+void clear_hash() {
+    for (int i = 0; i < hash_size; i++) {
+        free(hash_table[i].name);
+        free(hash_table[i].path);
+    }
+    free(hash_table);
+    hash_table = NULL;
+    hash_size = 0;
+    hash_used = 0;
+}
+
+// Re-stat the PATH directories at most once per second; a new or
+// removed executable changes its directory's mtime.
+static void validate_hash() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    if (now.tv_sec == last_check) return;
+    last_check = now.tv_sec;
+
+    struct stat st;
+    for (int i = 0; i < path_count; i++) {
+        struct timespec m = {0, 0};
+        if (stat(path_list[i], &st) == 0) m = st.st_mtim;
+        if (m.tv_sec != dir_mtime[i].tv_sec || m.tv_nsec != dir_mtime[i].tv_nsec) {
+            clear_hash();
+            return;
+        }
+    }
+}
+
+static struct hash_entry *hash_slot(const char *cmd) {
+    unsigned mask = hash_size - 1;
+    unsigned i = hash_name(cmd) & mask;
+    while (hash_table[i].name && strcmp(hash_table[i].name, cmd) != 0) {
+        i = (i + 1) & mask;
+    }
+    return &hash_table[i];
+}
+
+static void grow_hash() {
+    struct hash_entry *old = hash_table;
+    int old_size = hash_size;
+
+    hash_size = old_size ? old_size * 2 : 64;
+    hash_table = calloc(hash_size, sizeof(*hash_table));
+    if (!hash_table) {
+        perror("hash table allocation failed");
+        exit(1);
+    }
+    if (!old) snapshot_dirs();
+
+    for (int i = 0; i < old_size; i++) {
+        if (old[i].name) *hash_slot(old[i].name) = old[i];
+    }
+    free(old);
+}
+
+static char *search_path(const char *cmd) {
+    char full_path[512];
+    for (int i = 0; i < path_count; i++) {
+        snprintf(full_path, sizeof(full_path), "%s/%s", path_list[i], cmd);
+        if (access(full_path, X_OK) == 0) return strdup(full_path);
+    }
+    return NULL;
+}
+
+// miss, if given, is set when cmd had to be searched for
+static struct hash_entry *lookup_hash(const char *cmd, int *miss) {
+    if (hash_table) validate_hash();
+    if (2 * (hash_used + 1) > hash_size) grow_hash();
+
+    struct hash_entry *e = hash_slot(cmd);
+    if (miss) *miss = !e->name;
+    if (!e->name) {
+        e->name = strdup(cmd);
+        e->path = search_path(cmd);
+        e->hits = 0;
+        hash_used++;
+    }
+    return e;
+}
+
+void print_hash(int fd) {
+    if (hash_used == 0) {
+        dprintf(fd, "hash: hash table empty\n");
+        return;
+    }
+    dprintf(fd, "hits\tcommand\n");
+    for (int i = 0; i < hash_size; i++) {
+        struct hash_entry *e = &hash_table[i];
+        if (!e->name) continue;
+        if (e->path) dprintf(fd, "%4u\t%s\n", e->hits, e->path);
+        else dprintf(fd, "%4u\t%s (not found)\n", e->hits, e->name);
+    }
+}
+
+int prime_hash(const char *cmd) {
+    return lookup_hash(cmd, NULL)->path != NULL;
+}
+
+// === Path Management ===
+// path_list is PATH split on ':'. Editing it sets PATH, and setting PATH
+// (export, unset, NAME=value) reloads it through load_path().
+void load_path(const char *value) {
+    for (int i = 0; i < path_count; i++) free(path_list[i]);
+    path_count = 0;
+    clear_hash();
+    if (!value) return;
 
-    char *copy = strdup(env_path);
+    char *copy = strdup(value);
     char *token = strtok(copy, ":");
     while (token && path_count < MAX_PATHS) {
         path_list[path_count++] = strdup(token);
@@ -20,43 +163,73 @@ void init_path() {
     free(copy);
 }
 
-void print_path() {
+void init_path() {
+    load_path(env_get("PATH"));
+}
+
+void print_path(int fd) {
     for (int i = 0; i < path_count; i++) {
-        printf("%s", path_list[i]);
-        if (i < path_count - 1) printf(":");
+        dprintf(fd, "%s%s", path_list[i], i < path_count - 1 ? ":" : "\n");
     }
-    printf("\n");
+    if (path_count == 0) dprintf(fd, "\n");
 }
 
-void add_path(const char *new_path) {
-    if (path_count < MAX_PATHS && new_path) {
-        path_list[path_count++] = strdup(new_path);
+// Set PATH to path_list with entry skip left out and extra, if given,
+// appended
+static void store_path(int skip, const char *extra) {
+    size_t len = extra ? strlen(extra) + 1 : 1;
+    for (int i = 0; i < path_count; i++) len += strlen(path_list[i]) + 1;
+    char *value = malloc(len);
+    if (!value) {
+        perror("path allocation failed");
+        return;
+    }
+
+    char *p = value;
+    *p = '\0';
+    for (int i = 0; i < path_count; i++) {
+        if (i != skip) p += sprintf(p, "%s%s", p > value ? ":" : "", path_list[i]);
     }
+    if (extra) sprintf(p, "%s%s", p > value ? ":" : "", extra);
+    env_set("PATH", value);
+    free(value);
+}
+
+void add_path(const char *new_path) {
+    if (path_count < MAX_PATHS && new_path) store_path(-1, new_path);
 }
 
 void remove_path(const char *target) {
     if (!target) return;
-    int found = -1;
     for (int i = 0; i < path_count; i++) {
         if (strcmp(path_list[i], target) == 0) {
-            found = i;
-            free(path_list[i]);
-            break;
+            store_path(i, NULL);
+            return;
         }
     }
-    if (found != -1) {
-        for (int i = found; i < path_count - 1; i++) {
-            path_list[i] = path_list[i + 1];
+}
+
+// Search the ':'-separated dirs for cmd without the cache, for commands
+// run with their own PATH. Returns a malloc'd path, or NULL.
+char *search_dirs(const char *cmd, const char *dirs) {
+    char full_path[512];
+    while (*dirs) {
+        size_t n = strcspn(dirs, ":");
+        if (n > 0) {
+            snprintf(full_path, sizeof(full_path), "%.*s/%s", (int)n, dirs, cmd);
+            if (access(full_path, X_OK) == 0) return strdup(full_path);
         }
-        path_count--;
+        dirs += n + (dirs[n] == ':');
     }
+    return NULL;
 }
 
 char *find_executable(char *cmd) {
-    static char full_path[512];
-    for (int i = 0; i < path_count; i++) {
-        snprintf(full_path, sizeof(full_path), "%s/%s", path_list[i], cmd);
-        if (access(full_path, X_OK) == 0) return full_path;
-    }
-    return NULL;
+    uint64_t t0 = stat_clock();
+    int miss;
+    struct hash_entry *e = lookup_hash(cmd, &miss);
+    e->hits++;
+    stat_count(miss ? COUNT_LOOKUP_MISSES : COUNT_LOOKUP_HITS, 1);
+    stat_time(STAT_LOOKUP, t0);
+    return e->path;
 }
@@ -7,9 +7,15 @@ extern char *path_list[MAX_PATHS];
 extern int path_count;
 
 void init_path();
-void print_path();
+void load_path(const char *value);
+void print_path(int fd);
 void add_path(const char *new_path);
 void remove_path(const char *target);
 char *find_executable(char *cmd);
+char *search_dirs(const char *cmd, const char *dirs);
+
+void print_hash(int fd);
+void clear_hash();
+int prime_hash(const char *cmd);
 
 #endif
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "reader.h"
+
+#define READ_CHUNK 65536
+
+void reader_open(struct line_reader *r, int fd) {
+    struct stat st;
+    memset(r, 0, sizeof(*r));
+    r->fd = fd;
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        off_t off = lseek(fd, 0, SEEK_CUR);
+        if (off < 0) off = 0;
+        char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            r->map = map;
+            r->map_size = st.st_size;
+            r->start = off < st.st_size ? off : st.st_size;
+            r->end = st.st_size;
+            // Commands may read an inherited script fd (e.g. shell < file);
+            // keep its offset just past the line being run, like sh does,
+            // and resume from wherever the command left it
+            r->sync_offset = !(fcntl(fd, F_GETFD) & FD_CLOEXEC);
+        }
+    }
+}
+
+// Refill the read() buffer, keeping the unconsumed tail and growing the
+// buffer when a single line does not fit. Returns bytes read, 0 at EOF.
+static ssize_t fill(struct line_reader *r) {
+    if (r->start > 0) {
+        memmove(r->buf, r->buf + r->start, r->end - r->start);
+        r->end -= r->start;
+        r->start = 0;
+    }
+    if (r->cap - r->end < READ_CHUNK / 2) {
+        r->cap = r->cap ? r->cap * 2 : READ_CHUNK;
+        r->buf = realloc(r->buf, r->cap);
+        if (!r->buf) {
+            perror("input buffer allocation failed");
+            exit(1);
+        }
+    }
+
+    ssize_t n;
+    do {
+        n = read(r->fd, r->buf + r->end, r->cap - r->end);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) return 0;
+    r->end += n;
+    return n;
+}
+
+// Returns the length of the next line including its newline (a final
+// line may have none) and points *line at it, or 0 at end of input.
+ssize_t reader_next(struct line_reader *r, const char **line) {
+    if (r->map) {
+        // A command may have consumed part of a shared script fd
+        if (r->sync_offset) {
+            off_t off = lseek(r->fd, 0, SEEK_CUR);
+            if (off >= 0 && (size_t)off <= r->end) r->start = off;
+        }
+        if (r->start == r->end) return 0;
+        const char *p = r->map + r->start;
+        const char *nl = memchr(p, '\n', r->end - r->start);
+        size_t len = nl ? (size_t)(nl - p) + 1 : r->end - r->start;
+        r->start += len;
+        if (r->sync_offset) lseek(r->fd, r->start, SEEK_SET);
+        *line = p;
+        return len;
+    }
+
+    size_t scanned = 0;     // bytes after start known to hold no newline
+    for (;;) {
+        size_t avail = r->end - r->start;
+        char *nl = NULL;
+        if (avail > scanned) nl = memchr(r->buf + r->start + scanned, '\n', avail - scanned);
+        if (nl) {
+            size_t len = nl - (r->buf + r->start) + 1;
+            *line = r->buf + r->start;
+            r->start += len;
+            return len;
+        }
+        scanned = avail;
+        if (r->eof || fill(r) == 0) {
+            r->eof = 1;
+            *line = r->buf + r->start;
+            r->start = r->end;
+            return avail;
+        }
+    }
+}
+
+void reader_close(struct line_reader *r) {
+    if (r->map) munmap(r->map, r->map_size);
+    free(r->buf);
+    memset(r, 0, sizeof(*r));
+}
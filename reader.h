@@ -0,0 +1,27 @@
+#ifndef READER_H
+#define READER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Line source with no length limit. Regular files are mapped and scanned
+// with memchr; anything else is read() into a reusable growable buffer.
+// Returned lines point into the map or buffer (no copy, no NUL) and stay
+// valid until the next reader_next() call.
+struct line_reader {
+    int fd;
+    int sync_offset;    // keep the fd offset at the next unread line
+    char *map;
+    size_t map_size;
+    char *buf;
+    size_t cap;
+    size_t start;
+    size_t end;
+    int eof;
+};
+
+void reader_open(struct line_reader *r, int fd);
+ssize_t reader_next(struct line_reader *r, const char **line);
+void reader_close(struct line_reader *r);
+
+#endif
@@ -0,0 +1,435 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "script.h"
+#include "batch.h"
+
+extern int should_exit;
+
+// === Compiled Script Cache ===
+// A batch file is parsed once into a self-contained image: a header, a
+// table of script_lines, the ASTs and strings they point to, and a
+// relocation table listing every pointer slot. Pointers are linked for a
+// preferred address derived from the content hash. When the image can be
+// mapped there it is used read-only as is; otherwise it is mapped
+// privately and each slot is rebased. Either way later runs skip lexing.
+// Images are named by a hash of the script contents.
+#define IMAGE_MAGIC "SHBC"
+#define IMAGE_VERSION 10
+#define IMAGE_BASE 0x200000000000ull
+
+struct image_header {
+    char magic[4];
+    uint32_t version;
+    uint64_t layout;        // AST struct sizes, to reject foreign builds
+    uint64_t hash;
+    uint64_t source_size;
+    uint64_t image_size;
+    uint64_t base;          // address the pointers are linked for
+    uint64_t lines;         // offset of the script_line table
+    uint64_t nlines;
+    uint64_t relocs;        // offset of the table of slot offsets / 8
+    uint64_t nrelocs;
+    uint64_t parse_ns;      // time it took to parse the source
+};
+
+struct image {
+    char *buf;
+    size_t len, cap;
+    uint64_t base;
+    uint32_t *relocs;
+    size_t nrelocs, relocs_cap;
+};
+
+static struct {
+    int hit;
+    uint64_t nlines;
+    uint64_t parse_ns;
+    uint64_t load_ns;
+} stats;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t layout_id() {
+    return sizeof(struct script_line) | sizeof(struct sequence) << 8 |
+           sizeof(struct pipeline) << 16 | sizeof(struct command) << 24 |
+           (uint64_t)sizeof(struct redir) << 32;
+}
+
+// 64-bit hash of the script, eight bytes per step
+static uint64_t hash_bytes(const char *p, size_t n) {
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ n;
+    while (n >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        h = (h ^ w) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+        p += 8;
+        n -= 8;
+    }
+    while (n--) h = (h ^ (unsigned char)*p++) * 0x100000001b3ull;
+    h ^= h >> 29;
+    return h;
+}
+
+// --- Image building ---
+static size_t img_alloc(struct image *im, size_t size, size_t align) {
+    im->len = (im->len + align - 1) & ~(align - 1);
+    if (im->len + size > im->cap) {
+        while (im->len + size > im->cap) im->cap = im->cap ? im->cap * 2 : 65536;
+        im->buf = realloc(im->buf, im->cap);
+        if (!im->buf) {
+            perror("script image allocation failed");
+            exit(1);
+        }
+    }
+    size_t off = im->len;
+    memset(im->buf + off, 0, size);
+    im->len += size;
+    return off;
+}
+
+// Link the pointer slot at slot_off to target_off and record the slot
+static void img_ptr(struct image *im, size_t slot_off, size_t target_off) {
+    uint64_t v = im->base + target_off;
+    memcpy(im->buf + slot_off, &v, sizeof(v));
+    if (im->nrelocs == im->relocs_cap) {
+        im->relocs_cap = im->relocs_cap ? im->relocs_cap * 2 : 1024;
+        im->relocs = realloc(im->relocs, im->relocs_cap * sizeof(uint32_t));
+        if (!im->relocs) {
+            perror("script image allocation failed");
+            exit(1);
+        }
+    }
+    im->relocs[im->nrelocs++] = slot_off / 8;
+}
+
+static size_t img_str(struct image *im, const char *s, size_t n) {
+    size_t off = img_alloc(im, n + 1, 1);
+    memcpy(im->buf + off, s, n);
+    return off;
+}
+
+#define AT(im, off, type) ((type *)((im)->buf + (off)))
+
+static size_t img_command(struct image *im, size_t off, struct command *cmd) {
+    AT(im, off, struct command)->argc = cmd->argc;
+    AT(im, off, struct command)->expand = cmd->expand;
+
+    size_t argv = img_alloc(im, (cmd->argc + 1) * sizeof(char *), 8);
+    img_ptr(im, off + offsetof(struct command, argv), argv);
+    for (int i = 0; i < cmd->argc; i++) {
+        size_t s = img_str(im, cmd->argv[i], strlen(cmd->argv[i]));
+        img_ptr(im, argv + i * sizeof(char *), s);
+    }
+
+    AT(im, off, struct command)->nassigns = cmd->nassigns;
+    size_t assigns = img_alloc(im, cmd->nassigns * sizeof(char *), 8);
+    img_ptr(im, off + offsetof(struct command, assigns), assigns);
+    for (int i = 0; i < cmd->nassigns; i++) {
+        size_t s = img_str(im, cmd->assigns[i], strlen(cmd->assigns[i]));
+        img_ptr(im, assigns + i * sizeof(char *), s);
+    }
+
+    size_t slot = off + offsetof(struct command, redirs);
+    for (struct redir *r = cmd->redirs; r; r = r->next) {
+        size_t node = img_alloc(im, sizeof(struct redir), 8);
+        AT(im, node, struct redir)->type = r->type;
+        img_ptr(im, slot, node);
+        size_t target = img_str(im, r->target, strlen(r->target));
+        img_ptr(im, node + offsetof(struct redir, target), target);
+        slot = node + offsetof(struct redir, next);
+    }
+    return off;
+}
+
+// The commands and branches of pl into the pipeline at off
+static void img_pipeline(struct image *im, size_t off, struct pipeline *pl) {
+    AT(im, off, struct pipeline)->ncmds = pl->ncmds;
+    AT(im, off, struct pipeline)->background = pl->background;
+    AT(im, off, struct pipeline)->timed = pl->timed;
+    AT(im, off, struct pipeline)->run_if = pl->run_if;
+    AT(im, off, struct pipeline)->cached = pl->cached;
+    AT(im, off, struct pipeline)->nbranches = pl->nbranches;
+
+    size_t cmds = img_alloc(im, pl->ncmds * sizeof(struct command), 8);
+    img_ptr(im, off + offsetof(struct pipeline, cmds), cmds);
+    for (int j = 0; j < pl->ncmds; j++) {
+        img_command(im, cmds + j * sizeof(struct command), &pl->cmds[j]);
+    }
+
+    size_t branches = img_alloc(im, pl->nbranches * sizeof(struct pipeline), 8);
+    img_ptr(im, off + offsetof(struct pipeline, branches), branches);
+    for (int b = 0; b < pl->nbranches; b++) {
+        img_pipeline(im, branches + b * sizeof(struct pipeline), &pl->branches[b]);
+    }
+}
+
+static size_t img_sequence(struct image *im, struct sequence *seq) {
+    size_t off = img_alloc(im, sizeof(struct sequence), 8);
+    AT(im, off, struct sequence)->npipes = seq->npipes;
+
+    size_t pipes = img_alloc(im, seq->npipes * sizeof(struct pipeline), 8);
+    img_ptr(im, off + offsetof(struct sequence, pipes), pipes);
+    for (int i = 0; i < seq->npipes; i++) {
+        img_pipeline(im, pipes + i * sizeof(struct pipeline), &seq->pipes[i]);
+    }
+    return off;
+}
+
+// Parse every line of src into an image. Lines are split exactly as the
+// batch reader splits them.
+static void build_image(struct image *im, const char *src, size_t size, uint64_t hash) {
+    struct parser parser = {0};
+    im->base = IMAGE_BASE + ((hash & 0xffff) << 28);
+    size_t hdr = img_alloc(im, sizeof(struct image_header), 8);
+    uint64_t nlines = 0;
+
+    for (size_t pos = 0; pos < size; nlines++) {
+        const char *nl = memchr(src + pos, '\n', size - pos);
+        pos = nl ? (size_t)(nl - src) + 1 : size;
+    }
+    size_t lines = img_alloc(im, nlines * sizeof(struct script_line), 8);
+
+    uint64_t parse_ns = 0;
+    size_t pos = 0;
+    for (uint64_t i = 0; i < nlines; i++) {
+        const char *line = src + pos;
+        const char *nl = memchr(line, '\n', size - pos);
+        size_t len = nl ? (size_t)(nl - line) + 1 : size - pos;
+        size_t slot = lines + i * sizeof(struct script_line);
+        pos += len;
+
+        img_ptr(im, slot + offsetof(struct script_line, text), img_str(im, line, len));
+
+        uint64_t start = now_ns();
+        struct sequence *seq = parse_line(&parser, line, len);
+        parse_ns += now_ns() - start;
+
+        if (seq) {
+            img_ptr(im, slot + offsetof(struct script_line, seq), img_sequence(im, seq));
+        } else {
+            AT(im, slot, struct script_line)->kind = LINE_SYNTAX_ERROR;
+            size_t error = img_str(im, parser.error, strlen(parser.error));
+            img_ptr(im, slot + offsetof(struct script_line, error), error);
+        }
+    }
+    parser_free(&parser);
+
+    size_t relocs = img_alloc(im, im->nrelocs * sizeof(uint32_t), 8);
+    memcpy(im->buf + relocs, im->relocs, im->nrelocs * sizeof(uint32_t));
+
+    struct image_header *h = AT(im, hdr, struct image_header);
+    memcpy(h->magic, IMAGE_MAGIC, 4);
+    h->version = IMAGE_VERSION;
+    h->layout = layout_id();
+    h->hash = hash;
+    h->source_size = size;
+    h->image_size = im->len;
+    h->base = im->base;
+    h->lines = lines;
+    h->nlines = nlines;
+    h->relocs = relocs;
+    h->nrelocs = im->nrelocs;
+    h->parse_ns = parse_ns;
+}
+
+// --- Image loading ---
+// Reject images that are stale, truncated or from another build
+static int valid_header(const struct image_header *h, size_t size, uint64_t hash,
+                        size_t source_size) {
+    if (size < sizeof(*h) || memcmp(h->magic, IMAGE_MAGIC, 4) != 0) return 0;
+    if (h->version != IMAGE_VERSION || h->layout != layout_id()) return 0;
+    if (h->hash != hash || h->source_size != source_size || h->image_size != size) return 0;
+    if (h->relocs > size || h->nrelocs > (size - h->relocs) / sizeof(uint32_t)) return 0;
+    if (h->lines > size || h->nlines > (size - h->lines) / sizeof(struct script_line)) return 0;
+    return 1;
+}
+
+// Rebase every pointer slot of an image loaded somewhere other than its
+// link address. Returns -1 if a slot points outside the image.
+static int relocate(char *base, struct image_header *h) {
+    uint64_t size = h->image_size;
+    uint32_t *relocs = (uint32_t *)(base + h->relocs);
+
+    for (uint64_t i = 0; i < h->nrelocs; i++) {
+        uint64_t slot = (uint64_t)relocs[i] * 8, v;
+        if (slot > size - sizeof(v)) return -1;
+        memcpy(&v, base + slot, sizeof(v));
+        if (v - h->base >= size) return -1;
+        uintptr_t p = (uintptr_t)base + (v - h->base);
+        memcpy(base + slot, &p, sizeof(p));
+    }
+    return 0;
+}
+
+// Map an image, at its link address if possible. Returns the mapping
+// (with *hp set) or MAP_FAILED if the image is unusable.
+static char *map_image(int fd, size_t size, uint64_t hash, size_t source_size,
+                       struct image_header **hp) {
+    struct image_header h;
+    if (pread(fd, &h, sizeof(h), 0) != sizeof(h)) return MAP_FAILED;
+    if (!valid_header(&h, size, hash, source_size)) return MAP_FAILED;
+
+    char *base = mmap((void *)(uintptr_t)h.base, size, PROT_READ,
+                      MAP_PRIVATE | MAP_FIXED_NOREPLACE, fd, 0);
+    if (base != MAP_FAILED && (uintptr_t)base == h.base) {
+        *hp = (struct image_header *)base;
+        return base;
+    }
+    if (base != MAP_FAILED) munmap(base, size);
+
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) return MAP_FAILED;
+    *hp = (struct image_header *)base;
+    if (relocate(base, *hp) < 0) {
+        munmap(base, size);
+        return MAP_FAILED;
+    }
+    return base;
+}
+
+// Cache files live in $SHELL_CACHE_DIR, else $XDG_CACHE_HOME/shell, else
+// ~/.cache/shell, which is created as needed. Returns 0 and fills dir, or
+// -1 if no directory is known.
+int cache_dir(char *dir, size_t size) {
+    const char *env;
+
+    if ((env = getenv("SHELL_CACHE_DIR"))) {
+        snprintf(dir, size, "%s", env);
+    } else if ((env = getenv("XDG_CACHE_HOME"))) {
+        snprintf(dir, size, "%s/shell", env);
+        mkdir(env, 0755);
+    } else if ((env = getenv("HOME"))) {
+        snprintf(dir, size, "%s/.cache", env);
+        mkdir(dir, 0755);
+        snprintf(dir, size, "%s/.cache/shell", env);
+    } else {
+        return -1;
+    }
+    mkdir(dir, 0755);
+    return 0;
+}
+
+// Images are named by the script's hash
+static int image_path(char *path, size_t size, uint64_t hash) {
+    char dir[4096];
+    if (cache_dir(dir, sizeof(dir)) < 0) return -1;
+    snprintf(path, size, "%s/%016llx.shbc", dir, (unsigned long long)hash);
+    return 0;
+}
+
+static void write_image(const char *path, struct image *im) {
+    char tmp[4200];
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("script cache write failed");
+        return;
+    }
+    size_t off = 0;
+    while (off < im->len) {
+        ssize_t n = write(fd, im->buf + off, im->len - off);
+        if (n <= 0) break;
+        off += n;
+    }
+    close(fd);
+    if (off != im->len || rename(tmp, path) != 0) {
+        perror("script cache write failed");
+        unlink(tmp);
+    }
+}
+
+static int run_lines(struct image_header *h, char *base, int max_jobs) {
+    struct script_line *lines = (struct script_line *)(base + h->lines);
+
+    batch_begin(max_jobs);
+    for (uint64_t i = 0; i < h->nlines && !should_exit; i++) {
+        struct script_line *l = &lines[i];
+        batch_line(l->text, strlen(l->text), l->seq, l->error);
+    }
+    return batch_end();
+}
+
+// Run a batch file from its compiled image, building (or, with rebuild,
+// replacing) the image first if needed.
+int run_compiled_script(const char *path, int max_jobs, int rebuild) {
+    uint64_t start = now_ns();
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror("Batch file open error");
+        exit(1);
+    }
+    size_t size = st.st_size;
+    char *src = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (src == MAP_FAILED) {
+        perror("Batch file mmap error");
+        exit(1);
+    }
+
+    uint64_t hash = hash_bytes(src, size);
+    char image_file[4200];
+    int have_path = image_path(image_file, sizeof(image_file), hash) == 0;
+
+    // Fast path: map the cached image and execute it directly
+    if (have_path && !rebuild && (fd = open(image_file, O_RDONLY | O_CLOEXEC)) >= 0) {
+        struct image_header *h = NULL;
+        char *base = MAP_FAILED;
+        if (fstat(fd, &st) == 0) base = map_image(fd, st.st_size, hash, size, &h);
+        close(fd);
+        if (base != MAP_FAILED) {
+            if (src) munmap(src, size);
+            stats.hit = 1;
+            stats.nlines = h->nlines;
+            stats.parse_ns = h->parse_ns;
+            stats.load_ns = now_ns() - start;
+            int status = run_lines(h, base, max_jobs);
+            munmap(base, st.st_size);
+            return status;
+        }
+    }
+
+    struct image im = {0};
+    build_image(&im, src, size, hash);
+    if (src) munmap(src, size);
+    if (have_path) write_image(image_file, &im);
+
+    struct image_header *h = (struct image_header *)im.buf;
+    relocate(im.buf, h);
+    stats.hit = 0;
+    stats.nlines = h->nlines;
+    stats.parse_ns = h->parse_ns;
+    stats.load_ns = now_ns() - start;
+    int status = run_lines(h, im.buf, max_jobs);
+    free(im.buf);
+    free(im.relocs);
+    return status;
+}
+
+void print_script_stats() {
+    if (stats.hit) {
+        double saved = ((double)stats.parse_ns - (double)stats.load_ns) / 1e6;
+        fprintf(stderr, "script cache: hit, %llu lines, load %.3f ms, parse time saved %.3f ms\n",
+                (unsigned long long)stats.nlines, stats.load_ns / 1e6, saved);
+    } else {
+        fprintf(stderr, "script cache: built, %llu lines, parse %.3f ms\n",
+                (unsigned long long)stats.nlines, stats.parse_ns / 1e6);
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <stddef.h>
+#include "parse.h"
+
+#define LINE_OK 0
+#define LINE_SYNTAX_ERROR 1
+
+// One batch line as stored in a compiled script image. After loading,
+// every pointer refers into the mapped image.
+struct script_line {
+    int kind;
+    const char *text;   // original line, for echoing
+    struct sequence *seq;
+    const char *error;  // syntax error message
+};
+
+int cache_dir(char *dir, size_t size);
+int run_compiled_script(const char *path, int max_jobs, int rebuild);
+void print_script_stats();
+
+#endif
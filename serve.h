@@ -0,0 +1,38 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stdint.h>
+
+// === Server Protocol ===
+// One SOCK_SEQPACKET message per request and per response. A request is
+// a serve_request followed by the command line, the cwd (may be empty)
+// and the environment overrides as NUL-terminated "NAME=value" (set) or
+// "NAME" (unset) strings. Up to three descriptors (stdin, stdout, stderr,
+// in that order) ride along as SCM_RIGHTS; missing ones are /dev/null.
+#define SERVE_MAGIC 0x53485356u     // "SHSV"
+#define SERVE_VERSION 1
+#define SERVE_MAX_REQUEST 65536
+
+struct serve_request {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t line_len;
+    uint32_t cwd_len;
+    uint32_t env_len;
+    uint32_t nfds;
+};
+
+// status is the line's exit status (2 for a syntax error), or 128+N when
+// the worker running it was killed by signal N. Times are microseconds.
+struct serve_response {
+    int32_t status;
+    int32_t signal;
+    int64_t real_us;
+    int64_t user_us;
+    int64_t sys_us;
+    int64_t max_rss_kb;
+};
+
+int run_server(const char *socket_path);
+
+#endif
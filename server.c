@@ -0,0 +1,388 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "serve.h"
+#include "arena.h"
+#include "builtins.h"
+#include "execute.h"
+#include "jobs.h"
+#include "parse.h"
+#include "path.h"
+#include "env.h"
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+// Parsed lines kept across requests (power of two); the table is emptied
+// when it is three quarters full
+#define SERVE_PARSE_CACHE 4096
+#define SERVE_BACKLOG 64
+
+// === Shell Server ===
+// One prewarmed shell accepts requests on a Unix socket. Each request
+// runs in a worker forked from the server, so cd, exit or a crash in one
+// request cannot leak into the next, while everything the server has
+// warmed (PATH table, executable-lookup cache, parsed lines) is inherited
+// for free. The server parses the line and resolves its commands before
+// forking, so those caches fill in the long-lived process rather than in
+// a worker that is about to exit. Clients, workers (through pidfds) and
+// the listening socket share one epoll loop.
+#define WATCH_LISTEN 0
+#define WATCH_CLIENT 1
+#define WATCH_WORKER 2
+
+struct conn;
+
+struct watch {
+    int kind;
+    struct conn *conn;
+};
+
+struct conn {
+    int fd;             // -1 once the client hung up
+    pid_t worker;       // 0 when idle
+    int pidfd;
+    struct timespec start;
+    struct watch client;
+    struct watch worker_watch;
+};
+
+struct parsed_line {
+    uint64_t hash;
+    const char *text;
+    size_t len;
+    struct sequence *seq;
+};
+
+static int epfd = -1;
+static int listen_fd = -1;
+static volatile sig_atomic_t stop_requested;
+
+static struct parsed_line parse_cache[SERVE_PARSE_CACHE];
+static int parse_cache_count;
+static struct arena parse_arena;
+static struct parser serve_parser;
+
+static void stop_handler(int signo) {
+    stop_requested = 1;
+}
+
+static uint64_t hash_line(const char *s, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)s[i]) * 0x100000001b3ull;
+    return h;
+}
+
+// Parse line, reusing the AST from an earlier identical request
+static struct sequence *cached_parse(const char *line, size_t len, const char **error) {
+    uint64_t h = hash_line(line, len);
+    unsigned slot = h & (SERVE_PARSE_CACHE - 1);
+
+    for (; parse_cache[slot].text; slot = (slot + 1) & (SERVE_PARSE_CACHE - 1)) {
+        struct parsed_line *p = &parse_cache[slot];
+        if (p->hash == h && p->len == len && memcmp(p->text, line, len) == 0) return p->seq;
+    }
+
+    struct sequence *seq = parse_line(&serve_parser, line, len);
+    if (!seq) {
+        *error = serve_parser.error;
+        return NULL;
+    }
+
+    if (parse_cache_count >= SERVE_PARSE_CACHE * 3 / 4) {
+        memset(parse_cache, 0, sizeof(parse_cache));
+        parse_cache_count = 0;
+        arena_reset(&parse_arena);
+        slot = h & (SERVE_PARSE_CACHE - 1);
+    }
+    struct parsed_line *p = &parse_cache[slot];
+    p->hash = h;
+    p->text = arena_strndup(&parse_arena, line, len);
+    p->len = len;
+    p->seq = copy_sequence(&parse_arena, seq);
+    parse_cache_count++;
+    return p->seq;
+}
+
+// Resolve every external command now so the server's lookup cache, which
+// each worker inherits, stays warm
+static void prime_lookups(struct sequence *seq) {
+    for (int i = 0; i < seq->npipes; i++) {
+        for (int j = 0; j < seq->pipes[i].ncmds; j++) {
+            struct command *cmd = &seq->pipes[i].cmds[j];
+            if (cmd->argc > 0 && !find_builtin(cmd->argv[0])) find_executable(cmd->argv[0]);
+        }
+    }
+}
+
+static void close_conn(struct conn *c) {
+    if (c->fd >= 0) close(c->fd);
+    free(c);
+}
+
+static void send_response(struct conn *c, int status, int signal, const struct rusage *ru) {
+    if (c->fd < 0) return;
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    struct serve_response resp = { .status = status, .signal = signal };
+    resp.real_us = (end.tv_sec - c->start.tv_sec) * 1000000 +
+                   (end.tv_nsec - c->start.tv_nsec) / 1000;
+    if (ru) {
+        resp.user_us = ru->ru_utime.tv_sec * 1000000 + ru->ru_utime.tv_usec;
+        resp.sys_us = ru->ru_stime.tv_sec * 1000000 + ru->ru_stime.tv_usec;
+        resp.max_rss_kb = ru->ru_maxrss;
+    }
+    if (send(c->fd, &resp, sizeof(resp), MSG_NOSIGNAL) < 0) perror("server response failed");
+}
+
+// Runs in the forked worker: install the request's descriptors, cwd and
+// environment, then run the line. Never returns.
+static void run_worker(struct sequence *seq, const char *cwd, const char *env, size_t env_len,
+                       int *fds, int nfds) {
+    close(listen_fd);
+    close(epfd);
+    reset_jobs_after_fork();
+    // The server's stop_handler would only set its flag here
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+
+    int devnull = open("/dev/null", O_RDWR);
+    for (int i = 0; i < 3; i++) {
+        int src = i < nfds ? fds[i] : devnull;
+        if (src != i) dup2(src, i);
+    }
+    for (int i = 0; i < nfds; i++) {
+        if (fds[i] > STDERR_FILENO) close(fds[i]);
+    }
+    if (devnull > STDERR_FILENO) close(devnull);
+
+    // PATH changes reach path_list (and clear the lookup cache) through
+    // the environment
+    for (const char *e = env; e < env + env_len; e += strlen(e) + 1) {
+        if (strchr(e, '=')) env_assign(e);
+        else env_unset(e);
+    }
+
+    if (*cwd && chdir(cwd) < 0) {
+        perror("cd failed");
+        exit(1);
+    }
+
+    int status = run_sequence(seq);
+    fflush(stdout);
+    fflush(stderr);
+    exit(status);
+}
+
+// Read one request and start its worker; returns -1 if the connection
+// should be dropped
+static int handle_request(struct conn *c) {
+    static char buf[SERVE_MAX_REQUEST];
+    char control[CMSG_SPACE(3 * sizeof(int))];
+    struct iovec iov = { buf, sizeof(buf) };
+    struct msghdr msg = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = control, .msg_controllen = sizeof(control),
+    };
+
+    ssize_t n = recvmsg(c->fd, &msg, MSG_CMSG_CLOEXEC);
+    if (n <= 0) return -1;
+
+    int fds[3], nfds = 0;
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+        if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) continue;
+        int count = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (int i = 0; i < count; i++) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cm) + i * sizeof(int), sizeof(int));
+            if (nfds < 3) fds[nfds++] = fd;
+            else close(fd);
+        }
+    }
+
+    struct serve_request req;
+    int valid = n >= (ssize_t)sizeof(req) && !(msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) &&
+                c->worker == 0;
+    if (valid) {
+        memcpy(&req, buf, sizeof(req));
+        valid = req.magic == SERVE_MAGIC && req.version == SERVE_VERSION &&
+                (size_t)req.line_len + req.cwd_len + req.env_len == n - sizeof(req) &&
+                (req.cwd_len == 0 || buf[sizeof(req) + req.line_len + req.cwd_len - 1] == '\0') &&
+                (req.env_len == 0 || buf[n - 1] == '\0');
+    }
+    if (!valid) {
+        for (int i = 0; i < nfds; i++) close(fds[i]);
+        return -1;
+    }
+
+    const char *line = buf + sizeof(req);
+    const char *cwd = req.cwd_len ? line + req.line_len : "";
+    const char *env = line + req.line_len + req.cwd_len;
+    clock_gettime(CLOCK_MONOTONIC, &c->start);
+
+    const char *error;
+    struct sequence *seq = cached_parse(line, req.line_len, &error);
+    if (!seq) {
+        if (nfds > 2) dprintf(fds[2], "syntax error: %s\n", error);
+        for (int i = 0; i < nfds; i++) close(fds[i]);
+        send_response(c, 2, 0, NULL);
+        return 0;
+    }
+    prime_lookups(seq);
+
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0) run_worker(seq, cwd, env, req.env_len, fds, nfds);
+    for (int i = 0; i < nfds; i++) close(fds[i]);
+    if (pid < 0) {
+        perror("fork failed");
+        send_response(c, 1, 0, NULL);
+        return 0;
+    }
+
+    c->worker = pid;
+    c->pidfd = syscall(SYS_pidfd_open, pid, 0);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &c->worker_watch };
+    if (c->pidfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, c->pidfd, &ev) < 0) {
+        perror("worker watch failed");
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        if (c->pidfd >= 0) close(c->pidfd);
+        c->worker = 0;
+        send_response(c, 1, 0, NULL);
+    }
+    return 0;
+}
+
+static void finish_worker(struct conn *c) {
+    siginfo_t info;
+    struct rusage ru;
+    memset(&ru, 0, sizeof(ru));
+    info.si_code = 0;
+    syscall(SYS_waitid, P_PIDFD, c->pidfd, &info, WEXITED, &ru);
+    epoll_ctl(epfd, EPOLL_CTL_DEL, c->pidfd, NULL);
+    close(c->pidfd);
+    c->worker = 0;
+
+    if (info.si_code == CLD_EXITED) send_response(c, info.si_status, 0, &ru);
+    else send_response(c, 128 + info.si_status, info.si_status, &ru);
+    if (c->fd < 0) close_conn(c);
+}
+
+static void accept_client() {
+    int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) return;
+
+    // Only the server's own user (or root) may run commands through it
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0 ||
+        (cred.uid != geteuid() && cred.uid != 0)) {
+        close(fd);
+        return;
+    }
+
+    struct conn *c = calloc(1, sizeof(*c));
+    if (!c) {
+        close(fd);
+        return;
+    }
+    c->fd = fd;
+    c->client = (struct watch){ WATCH_CLIENT, c };
+    c->worker_watch = (struct watch){ WATCH_WORKER, c };
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &c->client };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) close_conn(c);
+}
+
+static int open_socket(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket failed");
+        return -1;
+    }
+    // A leftover socket file from a server that is no longer running is
+    // replaced; a live one is left alone
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        fprintf(stderr, "a server is already listening on %s\n", path);
+        close(fd);
+        return -1;
+    }
+    unlink(path);
+
+    mode_t old = umask(077);
+    int ok = bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    umask(old);
+    if (!ok || listen(fd, SERVE_BACKLOG) < 0) {
+        perror("server socket setup failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int run_server(const char *socket_path) {
+    listen_fd = open_socket(socket_path);
+    if (listen_fd < 0) return 1;
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        perror("epoll_create1 failed");
+        return 1;
+    }
+
+    struct sigaction sa = { .sa_handler = stop_handler };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+
+    static struct watch listener = { WATCH_LISTEN, NULL };
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &listener };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev);
+
+    struct epoll_event events[64];
+    while (!stop_requested) {
+        int n = epoll_wait(epfd, events, 64, -1);
+        for (int i = 0; i < n; i++) {
+            struct watch *w = events[i].data.ptr;
+            struct conn *c = w->conn;
+            if (w->kind == WATCH_LISTEN) {
+                accept_client();
+            } else if (w->kind == WATCH_WORKER) {
+                finish_worker(c);
+            } else if (handle_request(c) < 0) {
+                // Client gone: drop it now, or once its worker finishes
+                epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+                close(c->fd);
+                c->fd = -1;
+                if (c->worker == 0) close_conn(c);
+            }
+        }
+    }
+
+    unlink(socket_path);
+    close(listen_fd);
+    return 0;
+}
@@ -1,36 +1,50 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "execute.h"
+#include "jobs.h"
+#include "history.h"
+#include "trace.h"
+#include "reader.h"
 #include "shell.h"
 
 int should_exit = 0;
 
+// Only async-signal-safe calls here: stdio may be mid-update
 void sigint_handler(int signo) {
-    printf("\n");
-    fflush(stdout);
+    write(STDOUT_FILENO, "\n", 1);
 }
 
-void run_shell(FILE *input, int interactive) {
-    char line[512];
+// Returns the status of the last command run, as the shell's exit status
+int run_shell(int input, int interactive) {
+    struct line_reader reader;
+    const char *line;
+    ssize_t len;
+
+    reader_open(&reader, input);
     while (!should_exit) {
+        notify_jobs();
         if (interactive) {
             printf("myshell> ");
             fflush(stdout);
         }
 
-        if (!fgets(line, sizeof(line), input)) break;
-
-        if (strlen(line) >= sizeof(line) - 1) {
-            fprintf(stderr, "Warning: input line too long\n");
-            continue;
-        }
+        uint64_t t0 = trace_start();
+        len = reader_next(&reader, &line);
+        trace_span("read", t0, NULL, 0);
+        if (len == 0) break;
 
         if (!interactive) {
-            printf("%s", line);
+            fwrite(line, 1, len, stdout);
             fflush(stdout);
+        } else {
+            history_add(line, len);
         }
 
-        parse_and_execute(line);
+        parse_and_execute(line, len);
     }
+    reader_close(&reader);
+    hangup_jobs();
+    return last_status;
 }
@@ -4,6 +4,6 @@
 #include <stdio.h>
 
 void sigint_handler(int signo);
-void run_shell(FILE *input, int interactive);
+int run_shell(int input, int interactive);
 
 #endif
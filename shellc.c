@@ -0,0 +1,130 @@
+// Client for `shell --serve`: runs one command line on a warm server with
+// this process's stdin, stdout and stderr, and exits with its status, so
+// it can stand in for `shell -c`.
+//
+// Usage: shellc [-s socket] [-C dir] [-E NAME=value | -U NAME]... [-v] -c command
+// The socket defaults to $SHELL_SERVER. -v prints the server-side resource
+// usage to stderr.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "serve.h"
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-s socket] [-C dir] [-E NAME=value | -U NAME]... [-v] "
+                    "-c command\n", prog);
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    static char buf[SERVE_MAX_REQUEST];
+    const char *socket_path = getenv("SHELL_SERVER");
+    const char *command = NULL, *cwd = "";
+    char env[SERVE_MAX_REQUEST];
+    size_t env_len = 0;
+    int verbose = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:C:E:U:vc:")) != -1) {
+        switch (opt) {
+        case 's':
+            socket_path = optarg;
+            break;
+        case 'C':
+            cwd = optarg;
+            break;
+        case 'E':
+        case 'U': {
+            size_t len = strlen(optarg) + 1;
+            int has_value = strchr(optarg, '=') != NULL;
+            if ((opt == 'E') != has_value || env_len + len > sizeof(env)) usage(argv[0]);
+            memcpy(env + env_len, optarg, len);
+            env_len += len;
+            break;
+        }
+        case 'v':
+            verbose = 1;
+            break;
+        case 'c':
+            command = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (!command || optind != argc) usage(argv[0]);
+    if (!socket_path) {
+        fprintf(stderr, "%s: no server socket (use -s or set SHELL_SERVER)\n", argv[0]);
+        return 2;
+    }
+
+    struct serve_request req = {
+        .magic = SERVE_MAGIC,
+        .version = SERVE_VERSION,
+        .line_len = strlen(command),
+        .cwd_len = *cwd ? strlen(cwd) + 1 : 0,
+        .env_len = env_len,
+        .nfds = 3,
+    };
+    size_t total = sizeof(req) + req.line_len + req.cwd_len + req.env_len;
+    if (total > sizeof(buf)) {
+        fprintf(stderr, "%s: request too large\n", argv[0]);
+        return 2;
+    }
+    char *p = buf;
+    memcpy(p, &req, sizeof(req));
+    p += sizeof(req);
+    memcpy(p, command, req.line_len);
+    p += req.line_len;
+    memcpy(p, cwd, req.cwd_len);
+    p += req.cwd_len;
+    memcpy(p, env, env_len);
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", argv[0]);
+        return 2;
+    }
+    strcpy(addr.sun_path, socket_path);
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("server connect failed");
+        return 2;
+    }
+
+    int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = { buf, total };
+    struct msghdr msg = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = control, .msg_controllen = sizeof(control),
+    };
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) < 0) {
+        perror("server request failed");
+        return 2;
+    }
+
+    struct serve_response resp;
+    if (recv(fd, &resp, sizeof(resp), 0) != sizeof(resp)) {
+        fprintf(stderr, "%s: no response from server\n", argv[0]);
+        return 2;
+    }
+    close(fd);
+
+    if (verbose) {
+        fprintf(stderr, "real %.3f  user %.3f  sys %.3f  maxrss %lldKB\n",
+                resp.real_us / 1e6, resp.user_us / 1e6, resp.sys_us / 1e6,
+                (long long)resp.max_rss_kb);
+    }
+    return resp.status;
+}
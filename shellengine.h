@@ -0,0 +1,54 @@
+#ifndef SHELLENGINE_H
+#define SHELLENGINE_H
+
+#include <stddef.h>
+
+// === Embeddable Shell Engine ===
+// Runs command lines in-process, without a /bin/sh per call. Each engine
+// has its own PATH table, working directory and output routing; engines
+// share no state, so threads may drive separate engines concurrently (one
+// engine must not be used by two threads at once). Lines use the shell's
+// syntax: quoting, ';', '|', '<' and '>'. Built in: cd, pwd, path, exit,
+// echo, printf, test/[, true and false. Background jobs ('&') are not
+// supported.
+
+struct shell_engine;
+
+// Called with each chunk a command writes; stream is 1 (stdout) or 2
+// (stderr). Calls for one run come from a single engine-owned thread and
+// never overlap, and all have returned when shell_engine_run() does.
+typedef void (*shell_output_fn)(void *ctx, int stream, const char *data, size_t len);
+
+struct shell_result {
+    int status;         // exit status of the last pipeline, as in sh
+    int signal;         // signal that killed its last stage, or 0
+    int exit_requested; // the line ran 'exit'
+    double real_seconds;
+    double user_seconds;    // CPU time of the line's processes
+    double sys_seconds;
+    long max_rss_kb;        // largest peak RSS among them
+};
+
+struct shell_engine *shell_engine_new();
+void shell_engine_free(struct shell_engine *e);
+
+// PATH is a ':'-separated list; NULL uses the process's $PATH
+int shell_engine_set_path(struct shell_engine *e, const char *path);
+int shell_engine_chdir(struct shell_engine *e, const char *dir);
+const char *shell_engine_cwd(struct shell_engine *e);
+
+// Descriptors for stdin/stdout/stderr (-1: /dev/null for stdin, the
+// process's own stdout/stderr otherwise). They stay owned by the caller.
+void shell_engine_set_fds(struct shell_engine *e, int in_fd, int out_fd, int err_fd);
+// Deliver stdout and stderr through fn instead (NULL to turn off)
+void shell_engine_set_output(struct shell_engine *e, shell_output_fn fn, void *ctx);
+
+// Parse and run one line. Returns the exit status (2 for a syntax error,
+// exit's argument if the line ran exit), or -1 with errno set if the
+// engine itself failed. That includes ECHILD when the host ignores
+// SIGCHLD, which reaps commands before their status can be read. result
+// may be NULL.
+int shell_engine_run(struct shell_engine *e, const char *line, size_t len,
+                     struct shell_result *result);
+
+#endif
@@ -0,0 +1,137 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include "spawn.h"
+
+extern char **environ;
+
+int spawn_method = SPAWN_POSIX;
+
+// SHELL_SPAWN=fork selects the plain fork()+execv() launch path
+void init_spawn() {
+    const char *method = getenv("SHELL_SPAWN");
+    if (method && strcmp(method, "fork") == 0) spawn_method = SPAWN_FORK;
+}
+
+// Lower both the soft and the hard limit so the command cannot raise
+// them back; the hard CPU limit is a second later, so SIGXCPU comes
+// first and SIGKILL follows if it is ignored
+static void set_limit(int resource, rlim_t value, rlim_t hard_extra) {
+    struct rlimit rl;
+    if (value == RLIM_INFINITY || getrlimit(resource, &rl) < 0) return;
+    if (rl.rlim_max != RLIM_INFINITY && value > rl.rlim_max) value = rl.rlim_max;
+    rl.rlim_cur = value;
+    if (rl.rlim_max == RLIM_INFINITY || value + hard_extra < rl.rlim_max) {
+        rl.rlim_max = value + hard_extra;
+    }
+    setrlimit(resource, &rl);
+}
+
+static void apply_limits(const struct spawn_limits *l) {
+    set_limit(RLIMIT_CPU, l->cpu, 1);
+    set_limit(RLIMIT_AS, l->as, 0);
+    set_limit(RLIMIT_NOFILE, l->nofile, 0);
+}
+
+// Fork with the same child setup posix_spawn would do (the shell ignores
+// SIGPIPE for its builtin threads and SIGTTOU for job control, and blocks
+// SIGCHLD; children get the defaults back). Returns 0 in the child, the
+// child's pid in the parent, or -1 on failure.
+pid_t fork_process(const struct spawn_io *io, pid_t pgid) {
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+
+    if (pid == 0) {
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTSTP, SIG_DFL);
+        signal(SIGPIPE, SIG_DFL);
+        signal(SIGTTOU, SIG_DFL);
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL);
+        if (pgid >= 0) setpgid(0, pgid);
+        if (io && io->in_fd >= 0) dup2(io->in_fd, STDIN_FILENO);
+        if (io && io->out_fd >= 0) dup2(io->out_fd, STDOUT_FILENO);
+        if (io && io->err_fd >= 0) dup2(io->err_fd, STDERR_FILENO);
+        if (io && io->cwd && chdir(io->cwd) < 0) {
+            perror("chdir failed");
+            _exit(126);
+        }
+        if (io && io->limits) apply_limits(io->limits);
+        return 0;
+    }
+
+    // Set the group from both sides so neither races the other
+    if (pgid >= 0) setpgid(pid, pgid ? pgid : pid);
+    return pid;
+}
+
+// posix_spawn() runs on clone(CLONE_VM|CLONE_VFORK) in glibc, so the
+// launch cost does not grow with the shell's page tables.
+static pid_t posix_spawn_process(const char *path, char **argv, const struct spawn_io *io,
+                                 pid_t pgid) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t sigs;
+    pid_t pid;
+
+    posix_spawn_file_actions_init(&actions);
+    if (io && io->in_fd >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, io->in_fd, STDIN_FILENO);
+    }
+    if (io && io->out_fd >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, io->out_fd, STDOUT_FILENO);
+    }
+    if (io && io->err_fd >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, io->err_fd, STDERR_FILENO);
+    }
+    if (io && io->cwd) posix_spawn_file_actions_addchdir_np(&actions, io->cwd);
+
+    posix_spawnattr_init(&attr);
+    short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+    if (pgid >= 0) flags |= POSIX_SPAWN_SETPGROUP;
+    posix_spawnattr_setflags(&attr, flags);
+    posix_spawnattr_setpgroup(&attr, pgid);
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTSTP);
+    sigaddset(&sigs, SIGPIPE);
+    sigaddset(&sigs, SIGTTOU);
+    posix_spawnattr_setsigdefault(&attr, &sigs);
+    sigemptyset(&sigs);
+    posix_spawnattr_setsigmask(&attr, &sigs);
+
+    int err = posix_spawn(&pid, path, &actions, &attr, argv, io && io->envp ? io->envp : environ);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+// Launch path with argv in process group pgid (0 = new group, -1 = stay in
+// the caller's). Returns the child's pid, or -1 with errno set if the
+// process could not be started. posix_spawn() cannot set resource
+// limits, so a limited child is always forked.
+pid_t spawn_process(const char *path, char **argv, const struct spawn_io *io, pid_t pgid) {
+    if (spawn_method == SPAWN_POSIX && !(io && io->limits)) {
+        return posix_spawn_process(path, argv, io, pgid);
+    }
+
+    pid_t pid = fork_process(io, pgid);
+    if (pid == 0) {
+        execve(path, argv, io && io->envp ? io->envp : environ);
+        perror("execv failed");
+        exit(1);
+    }
+    return pid;
+}
@@ -0,0 +1,38 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#define SPAWN_POSIX 0
+#define SPAWN_FORK 1
+
+// Resource limits set in the child before it runs; RLIM_INFINITY leaves
+// a resource as inherited
+struct spawn_limits {
+    rlim_t cpu;         // CPU seconds
+    rlim_t as;          // address space bytes
+    rlim_t nofile;      // open descriptors
+};
+
+// Descriptors to install as the child's stdin/stdout/stderr, or -1 to
+// inherit. Callers open them with O_CLOEXEC; dup2 clears the flag on the
+// target. cwd, if set, is the directory the child starts in, limits,
+// if set, are applied to it, and envp, if set, is its environment
+// (environ otherwise).
+struct spawn_io {
+    int in_fd;
+    int out_fd;
+    int err_fd;
+    const char *cwd;
+    const struct spawn_limits *limits;
+    char *const *envp;
+};
+
+extern int spawn_method;
+
+void init_spawn();
+pid_t spawn_process(const char *path, char **argv, const struct spawn_io *io, pid_t pgid);
+pid_t fork_process(const struct spawn_io *io, pid_t pgid);
+
+#endif
@@ -0,0 +1,213 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "stats.h"
+#include "utils.h"
+
+// === Session Statistics ===
+// Always-on counters and log-bucketed histograms of the hot path: parse,
+// executable lookup, spawn, wait and builtin times, and pipeline depths.
+// They live in a shared anonymous mapping updated with relaxed atomic
+// adds, so builtin stage threads and forked parallel batch slots all add
+// to the same totals. Recording costs a clock read and a few adds.
+// 'shellstat' prints or resets them, and SHELL_STATS=<file> writes them
+// as JSON when the shell exits.
+struct histogram {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[HIST_BUCKETS];
+};
+
+struct shell_stats {
+    struct histogram hist[STAT_HISTOGRAMS];
+    uint64_t counters[STAT_COUNTERS];
+};
+
+static const char *hist_names[STAT_HISTOGRAMS] = {
+    "parse", "lookup", "spawn", "wait", "builtin", "pipeline_depth"
+};
+static const char *counter_names[STAT_COUNTERS] = {
+    "lookup_hits", "lookup_misses", "bytes_redirected"
+};
+
+static struct shell_stats local;
+static struct shell_stats *stats = &local;
+static const char *dump_path;
+static pid_t dump_pid;
+
+uint64_t stat_clock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int bucket_of(uint64_t v) {
+    if (v < (1 << HIST_SUB_BITS)) return v;
+    int msb = 63 - __builtin_clzll(v);
+    int sub = (v >> (msb - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1);
+    return ((msb - HIST_SUB_BITS + 1) << HIST_SUB_BITS) + sub;
+}
+
+// Largest value that falls in bucket b
+static uint64_t bucket_high(int b) {
+    if (b < (1 << HIST_SUB_BITS)) return b;
+    int msb = (b >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+    uint64_t mantissa = (1 << HIST_SUB_BITS) | (b & ((1 << HIST_SUB_BITS) - 1));
+    uint64_t low = mantissa << (msb - HIST_SUB_BITS);
+    return low + ((uint64_t)1 << (msb - HIST_SUB_BITS)) - 1;
+}
+
+void stat_value(int h, uint64_t v) {
+    struct histogram *hg = &stats->hist[h];
+    __atomic_fetch_add(&hg->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hg->sum, v, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hg->buckets[bucket_of(v)], 1, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&hg->max, __ATOMIC_RELAXED);
+    while (v > max && !__atomic_compare_exchange_n(&hg->max, &max, v, 1,
+                                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+// Record the time since start, a stat_clock() reading
+void stat_time(int h, uint64_t start) {
+    stat_value(h, stat_clock() - start);
+}
+
+void stat_count(int c, uint64_t n) {
+    __atomic_fetch_add(&stats->counters[c], n, __ATOMIC_RELAXED);
+}
+
+// The p-th percentile, to within its bucket (and never above the max)
+static uint64_t percentile(const struct histogram *hg, double p) {
+    uint64_t rank = (uint64_t)(p * hg->count + 0.999999), seen = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += hg->buckets[b];
+        if (seen >= rank && seen > 0) {
+            uint64_t high = bucket_high(b);
+            return high < hg->max ? high : hg->max;
+        }
+    }
+    return hg->max;
+}
+
+static void put_num(struct outbuf *o, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void put_num(struct outbuf *o, const char *fmt, ...) {
+    char buf[64];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    out_write(o, buf, n);
+}
+
+// A latency in the largest unit that keeps it above 1
+static void put_time(struct outbuf *o, double ns) {
+    if (ns < 1e3) put_num(o, "%9.0fns", ns);
+    else if (ns < 1e6) put_num(o, "%9.1fus", ns / 1e3);
+    else if (ns < 1e9) put_num(o, "%9.1fms", ns / 1e6);
+    else put_num(o, "%9.2fs ", ns / 1e9);
+}
+
+static void write_table(struct outbuf *o, const struct shell_stats *s) {
+    static const double ps[] = { 0.5, 0.9, 0.99 };
+    out_str(o, "                 count       mean        p50        p90        p99        max\n");
+    for (int h = 0; h < STAT_HISTOGRAMS; h++) {
+        const struct histogram *hg = &s->hist[h];
+        double mean = hg->count ? (double)hg->sum / hg->count : 0;
+        put_num(o, "%-14s %7llu", hist_names[h], (unsigned long long)hg->count);
+        if (h == STAT_DEPTH) {
+            put_num(o, " %10.2f", mean);
+            for (int k = 0; k < 3; k++) {
+                put_num(o, " %10llu", (unsigned long long)percentile(hg, ps[k]));
+            }
+            put_num(o, " %10llu\n", (unsigned long long)hg->max);
+            continue;
+        }
+        out_str(o, " ");
+        put_time(o, mean);
+        for (int k = 0; k < 3; k++) {
+            out_str(o, " ");
+            put_time(o, percentile(hg, ps[k]));
+        }
+        out_str(o, " ");
+        put_time(o, hg->max);
+        out_str(o, "\n");
+    }
+    for (int c = 0; c < STAT_COUNTERS; c++) {
+        put_num(o, "%-16s %llu\n", counter_names[c], (unsigned long long)s->counters[c]);
+    }
+}
+
+static void write_json(struct outbuf *o, const struct shell_stats *s) {
+    out_str(o, "{");
+    for (int h = 0; h < STAT_HISTOGRAMS; h++) {
+        const struct histogram *hg = &s->hist[h];
+        const char *unit = h == STAT_DEPTH ? "" : "_ns";
+        put_num(o, "\"%s\":{\"count\":%llu,", hist_names[h], (unsigned long long)hg->count);
+        put_num(o, "\"mean%s\":%.1f,", unit, hg->count ? (double)hg->sum / hg->count : 0.0);
+        put_num(o, "\"p50%s\":%llu,", unit, (unsigned long long)percentile(hg, 0.5));
+        put_num(o, "\"p90%s\":%llu,", unit, (unsigned long long)percentile(hg, 0.9));
+        put_num(o, "\"p99%s\":%llu,", unit, (unsigned long long)percentile(hg, 0.99));
+        put_num(o, "\"max%s\":%llu},", unit, (unsigned long long)hg->max);
+    }
+    for (int c = 0; c < STAT_COUNTERS; c++) {
+        put_num(o, "\"%s\":%llu%s", counter_names[c], (unsigned long long)s->counters[c],
+                c + 1 < STAT_COUNTERS ? "," : "}\n");
+    }
+}
+
+// Only the shell that read SHELL_STATS writes the file, not its forks
+static void dump_stats() {
+    if (getpid() != dump_pid) return;
+    int fd = open(dump_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("stats file open failed");
+        return;
+    }
+    struct outbuf o = { .fd = fd };
+    write_json(&o, stats);
+    out_flush(&o);
+    close(fd);
+}
+
+void init_stats() {
+    struct shell_stats *shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE,
+                                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared != MAP_FAILED) stats = shared;
+
+    const char *path = getenv("SHELL_STATS");
+    if (!path || !*path) return;
+    dump_path = path;
+    dump_pid = getpid();
+    atexit(dump_stats);
+}
+
+// shellstat [-j] [-r]: print the statistics (as JSON with -j), or reset
+// them with -r
+int builtin_shellstat(char **args, struct builtin_io *io) {
+    int json = 0, reset = 0;
+    for (int i = 1; args[i]; i++) {
+        if (strcmp(args[i], "-j") == 0) {
+            json = 1;
+        } else if (strcmp(args[i], "-r") == 0) {
+            reset = 1;
+        } else {
+            dprintf(io->err, "Usage: shellstat [-j] [-r]\n");
+            return 2;
+        }
+    }
+
+    struct outbuf o = { .fd = io->out };
+    if (json) write_json(&o, stats);
+    else if (!reset) write_table(&o, stats);
+    out_flush(&o);
+    if (reset) memset(stats, 0, sizeof(*stats));
+    return o.failed;
+}
@@ -0,0 +1,33 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include "builtins.h"
+
+// Histograms: latencies in ns, except the pipeline depth in commands
+#define STAT_PARSE 0
+#define STAT_LOOKUP 1
+#define STAT_SPAWN 2
+#define STAT_WAIT 3
+#define STAT_BUILTIN 4
+#define STAT_DEPTH 5
+#define STAT_HISTOGRAMS 6
+
+#define COUNT_LOOKUP_HITS 0
+#define COUNT_LOOKUP_MISSES 1
+#define COUNT_REDIRECT_BYTES 2
+#define STAT_COUNTERS 3
+
+// Four buckets per power of two: values below 4 are exact, larger ones
+// within 25%
+#define HIST_SUB_BITS 2
+#define HIST_BUCKETS (64 << HIST_SUB_BITS)
+
+void init_stats();
+uint64_t stat_clock();
+void stat_time(int h, uint64_t start);
+void stat_value(int h, uint64_t v);
+void stat_count(int c, uint64_t n);
+int builtin_shellstat(char **args, struct builtin_io *io);
+
+#endif
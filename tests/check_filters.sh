@@ -0,0 +1,60 @@
+#!/bin/sh
+# Differential test of the in-shell head, wc, grep -F and tee, driven by
+# `make check`. Each command runs under ./shell (with a file operand and
+# reading a pipe, so both the operand and the pipeline-stage paths are
+# taken) and under /bin/sh with the system's coreutils and grep, and the
+# output bytes and exit statuses must match.
+cd "$(dirname "$0")/.."
+SHELL_BIN=$(pwd)/shell
+export LC_ALL=C
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+export SHELL_CACHE_DIR="$WORK/cache"
+export SHELL_HISTFILE="$WORK/history"
+cd "$WORK"
+
+# Inputs: empty, no trailing newline, lines longer than 16 bytes, CRLF
+# line ends, matches and newlines on every offset around a 16-byte vector
+# boundary, and more than one read buffer
+: > empty
+printf 'abc\ndef needle\nghi' > nonl
+awk 'BEGIN { for (i = 0; i < 300; i++) { s = ""; for (k = 0; k < i % 97; k++) s = s sprintf("%c", 97 + k % 26); print s } }' > long
+printf 'one\r\ntwo needle\r\n\r\nthree\r\n' > crlf
+awk 'BEGIN { for (i = 0; i < 40; i++) { s = ""; for (k = 0; k < i; k++) s = s "x"; print s "needle" s } }' > boundary
+awk 'BEGIN { for (i = 0; i < 64; i++) { s = ""; for (k = 0; k < i; k++) s = s "n"; printf "%s\n", s } }' > newlines
+awk 'BEGIN { for (i = 0; i < 200000; i++) print i, (i % 7 == 0 ? "needle" : "hay") }' > big
+INPUTS="empty nonl long crlf boundary newlines big"
+
+failed=0
+total=0
+
+# compare <description> <line>: run line under both shells
+compare() {
+    total=$((total + 1))
+    rm -f t.out t.stdout ta.out
+    timeout 10 "$SHELL_BIN" -c "$2" > got 2>&1
+    got_status=$?
+    rm -f t.out t.stdout ta.out
+    /bin/sh -c "$2" > exp 2>&1
+    exp_status=$?
+    if [ "$got_status" != "$exp_status" ] || ! cmp -s got exp; then
+        failed=$((failed + 1))
+        echo "FAIL $1: $2 (status $got_status, expected $exp_status)"
+    fi
+}
+
+for f in $INPUTS; do
+    for cmd in "head" "head -n 3" "head -3" "head -n 0" "head -n 100000" "head -c 5" "head -c 17" \
+               "wc -l" "wc -c" "wc" \
+               "grep -F needle" "grep -F -v needle" "grep -F -c needle" "grep -F -q needle" \
+               "grep -F xneedlex" "grep -F abc"; do
+        compare "$f operand" "$cmd $f"
+        compare "$f piped" "cat $f | $cmd"
+    done
+    compare "$f tee" "cat $f | tee t.out > t.stdout; cat t.out t.stdout"
+    compare "$f tee -a" "cat $f | tee -a ta.out > /dev/null; cat $f | tee -a ta.out > /dev/null; cat ta.out"
+done
+
+echo "$((total - failed))/$total filter checks passed"
+[ "$failed" = 0 ]
@@ -0,0 +1,126 @@
+#!/bin/sh
+# Regression tests driven by `make check`. Each case runs one line under
+# ./shell -c (or a batch file) with a timeout, in a scratch directory, and
+# compares its output and exit status with the expected ones.
+cd "$(dirname "$0")/.."
+SHELL_BIN=$(pwd)/shell
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+export SHELL_CACHE_DIR="$WORK/cache"
+export SHELL_HISTFILE="$WORK/history"
+
+failed=0
+total=0
+
+check() {
+    total=$((total + 1))
+    if [ "$status" != "$2" ] || [ "$got" != "$3" ]; then
+        failed=$((failed + 1))
+        printf 'FAIL %s: status %s, output:\n%s\n' "$1" "$status" "$got"
+    fi
+}
+
+# expect <name> <status> <expected output> <line>
+expect() {
+    got=$(cd "$WORK" && timeout 10 "$SHELL_BIN" -c "$4" 2>&1)
+    status=$?
+    check "$@"
+}
+
+# expect_batch <name> <status> <expected output> <options> <script>
+# Batch mode echoes each line before running it.
+expect_batch() {
+    printf '%s\n' "$5" > "$WORK/batch"
+    got=$(cd "$WORK" && timeout 10 "$SHELL_BIN" $4 batch 2>&1)
+    status=$?
+    check "$@"
+}
+
+# A builtin producer must not leave its pipe's write end open in a forked
+# builtin consumer, or the consumer never sees EOF
+expect "builtin-into-parallel" 0 "a
+b" "printf 'a\nb\n' | parallel -k echo {}"
+expect "builtin-into-forked-builtin" 0 "x" "echo x | parallel -k echo {}"
+
+# Status: && and || short-circuit on $?, which is 127 for a missing
+# command and 2 for a syntax error
+expect "and-or" 0 "a
+b" "true && echo a || echo no; false && echo no || echo b"
+expect "and-or-chain" 0 "1" "false || false && echo no; echo \$?"
+expect "status-not-found" 0 "command not found: no_such_command_x
+127" "no_such_command_x; echo \$?"
+expect "status-syntax" 2 "syntax error: unterminated quote" "echo 'open"
+expect "status-last" 1 "" "true; false"
+
+# exit [n]: n, or the last status; later commands do not run
+expect "exit-n" 7 "" "exit 7; echo no"
+expect "exit-last" 1 "" "false; exit"
+expect "exit-wraps" 44 "" "exit 300"
+
+# set -e and -e stop at the first failure, also with -j slots running
+expect "set-e" 1 "a" "set -e; echo a; false; echo b"
+expect "set-e-and-or" 0 "a
+b" "set -e; false || echo a; false && echo no; echo b"
+expect_batch "batch-e" 1 "echo one
+one
+false" "-e" "echo one
+false
+echo never"
+expect_batch "batch-e-j" 1 "echo one
+one
+sleep 0.2; false" "-e -j 2" "echo one
+sleep 0.2; false
+sleep 5; echo late
+echo never"
+
+# Command substitution
+expect "subst" 0 "sub bq" "echo \$(echo sub) \`echo bq\`"
+expect "subst-split" 0 "3
+a b c" "printf '%s\n' \$(echo a b c) | wc -l; echo \"\$(printf 'a b c\n\n')\""
+expect "subst-status" 0 "1
+0" "x=\$(false); echo \$?; false; x=\$(true) y=1; echo \$?"
+
+# Globs match sorted names; quoted or unmatched patterns stay as they are
+expect "glob" 0 "g1.c g2.c
+g*.c
+z*.q
+g3.h" "touch g1.c g2.c g3.h; echo g*.c; echo 'g*.c'; echo z*.q; echo g[!12].?"
+
+# Variables: export reaches children, a prefix assignment only its command
+expect "export" 0 "bar" "export FOO=bar; sh -c 'echo \$FOO'"
+expect "prefix-assign" 0 "pre
+[]" "FOO=pre sh -c 'echo \$FOO'; echo \"[\$FOO]\""
+expect "assign-unset" 0 "v
+[]" "V=v; echo \$V; unset V; echo \"[\$V]\""
+
+# limit: the timeout kills the pipeline and reports 124
+expect "limit-timeout" 124 "timed out: sleep 5" "limit -t 0.3 sleep 5"
+expect "limit-background" 124 "timed out: sleep 5" "limit -t 0.3 sleep 5 & wait %1"
+expect "limit-ok" 0 "fast" "limit -t 5 echo fast"
+
+# Fan-out: every branch reads the whole output
+expect "fanout" 0 "a
+b
+2
+B
+A" "printf 'b\na\n' |> (sort > f1) (wc -l > f2) (tr a-z A-Z > f3); cat f1 f2 f3"
+expect "fanout-status" 1 "" "echo x |> (cat > /dev/null) (false)"
+
+# Redirections
+expect "redir-out-append" 0 "o
+a" "echo o > r1; echo a >> r1; cat r1"
+expect "redir-in" 0 "2" "printf '1\n2\n' > r2; wc -l < r2"
+expect "redir-err" 0 "err" "sh -c 'echo out; echo err >&2' 2> r3 > /dev/null; cat r3"
+expect "redir-err-to-out" 0 "out
+err" "sh -c 'echo out; echo err >&2' > r4 2>&1; cat r4"
+expect "redir-all" 0 "out
+err
+out
+err" "sh -c 'echo out; echo err >&2' &> r5; sh -c 'echo out; echo err >&2' &>> r5; cat r5"
+expect "redir-pipe-err" 0 "out
+err" "sh -c 'echo out; echo err >&2' 2>&1 | cat"
+expect "redir-missing" 1 "input redirection failed: No such file or directory" "cat < no_such_file"
+
+echo "$((total - failed))/$total shell checks passed"
+[ "$failed" = 0 ]
@@ -0,0 +1,93 @@
+// Regression tests for libshellengine, driven by `make check`. Each case
+// runs one line on a fresh engine with output captured through the
+// callback and checks the returned status, the result and the stdout.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include "../shellengine.h"
+
+struct capture {
+    char buf[4096];
+    size_t len;
+};
+
+static void capture_output(void *ctx, int stream, const char *data, size_t len) {
+    struct capture *c = ctx;
+    if (stream != 1 || len > sizeof(c->buf) - 1 - c->len) return;
+    memcpy(c->buf + c->len, data, len);
+    c->len += len;
+    c->buf[c->len] = '\0';
+}
+
+static int total, failed;
+
+static void expect(const char *line, int status, int exit_requested, const char *out) {
+    struct shell_engine *e = shell_engine_new();
+    struct capture c = { .len = 0 };
+    struct shell_result r;
+    if (!e) {
+        perror("shell_engine_new");
+        exit(1);
+    }
+    shell_engine_set_output(e, capture_output, &c);
+    int got = shell_engine_run(e, line, strlen(line), &r);
+
+    total++;
+    if (got != status || r.status != status || r.exit_requested != exit_requested ||
+        strcmp(c.buf, out) != 0) {
+        failed++;
+        printf("FAIL %s: status %d (result %d, exit %d), expected %d (exit %d); "
+               "output '%s', expected '%s'\n",
+               line, got, r.status, r.exit_requested, status, exit_requested, c.buf, out);
+    }
+    shell_engine_free(e);
+}
+
+// With SIGCHLD ignored the kernel reaps children itself, so their status
+// is lost: the run must fail with ECHILD rather than invent one
+static void expect_ignored_sigchld(const char *line) {
+    struct shell_engine *e = shell_engine_new();
+    struct shell_result r;
+    signal(SIGCHLD, SIG_IGN);
+    int got = shell_engine_run(e, line, strlen(line), &r);
+    int saved = errno;
+    signal(SIGCHLD, SIG_DFL);
+
+    total++;
+    if (got != -1 || saved != ECHILD || r.signal != 0 ||
+        r.user_seconds != 0 || r.sys_seconds != 0) {
+        failed++;
+        printf("FAIL %s with SIGCHLD ignored: returned %d (%s), signal %d, user %g, sys %g\n",
+               line, got, strerror(saved), r.signal, r.user_seconds, r.sys_seconds);
+    }
+    shell_engine_free(e);
+}
+
+int main() {
+    expect("echo hi", 0, 0, "hi\n");
+    expect("false", 1, 0, "");
+    expect("echo 'a b' | cat", 0, 0, "a b\n");
+    expect("echo x >", 2, 0, "");
+
+    // exit ends the line with its argument, or the previous status
+    expect("exit 3", 3, 1, "");
+    expect("exit 3; echo no", 3, 1, "");
+    expect("echo yes; exit 300", 44, 1, "yes\n");
+    expect("false; exit", 1, 1, "");
+    expect("exit", 0, 1, "");
+    expect("false || exit 5", 5, 1, "");
+    expect("true || exit 5", 0, 0, "");
+
+    // In a pipeline exit runs on a thread and, as in sh, ends nothing
+    expect("exit 4 | cat; echo after", 0, 0, "after\n");
+    expect("true | exit 4", 4, 0, "");
+
+    expect("/bin/false", 1, 0, "");
+    expect_ignored_sigchld("/bin/false");
+    expect_ignored_sigchld("sh -c 'exit 3' | cat");
+
+    printf("%d/%d engine checks passed\n", total - failed, total);
+    return failed != 0;
+}
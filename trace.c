@@ -0,0 +1,134 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "trace.h"
+
+// === Tracing ===
+// SHELL_TRACE=<file> records spans of the shell's hot path (line read,
+// parse, executable lookup, spawn, wait, builtins, and each child's run
+// time) as Chrome trace-event JSON, viewable in chrome://tracing or
+// Perfetto. Events are buffered per process and appended with O_APPEND
+// writes of whole events, so parallel batch slots can share the file.
+// With tracing off every hook is a single branch.
+#define TRACE_BUFFER_SIZE 65536
+#define TRACE_EVENT_MAX 512
+
+int trace_enabled = 0;
+
+static int trace_fd = -1;
+static pid_t trace_pid;     // the shell that opened the file closes the array
+static pid_t self;
+static char buf[TRACE_BUFFER_SIZE];
+static size_t buf_len;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void trace_flush() {
+    size_t off = 0;
+    while (off < buf_len) {
+        ssize_t n = write(trace_fd, buf + off, buf_len - off);
+        if (n <= 0) break;
+        off += n;
+    }
+    buf_len = 0;
+}
+
+// Each event ends in ",\n"; the closing metadata event makes the file
+// valid JSON once the shell exits
+static void finish_trace() {
+    if (self == trace_pid) {
+        buf_len += snprintf(buf + buf_len, sizeof(buf) - buf_len,
+                            "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                            "\"args\":{\"name\":\"shell\"}}\n]\n",
+                            (int)trace_pid);
+    }
+    trace_flush();
+}
+
+// A forked copy of the shell starts with an empty buffer (the parent
+// still owns the pending events) and records under its own pid
+static void trace_child() {
+    self = getpid();
+    buf_len = 0;
+}
+
+void init_trace() {
+    const char *path = getenv("SHELL_TRACE");
+    if (!path || !*path) return;
+
+    trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (trace_fd < 0) {
+        perror("trace file open failed");
+        return;
+    }
+    trace_pid = self = getpid();
+    trace_enabled = 1;
+    pthread_atfork(NULL, NULL, trace_child);
+    // Written now, ahead of any events forked slots append
+    if (write(trace_fd, "[\n", 2) != 2) perror("trace file write failed");
+    atexit(finish_trace);
+}
+
+// Start timestamp for a span, or 0 when tracing is off
+uint64_t trace_start() {
+    return trace_enabled ? now_ns() : 0;
+}
+
+// Append s as a JSON string body, cut short at limit bytes
+static size_t json_escape(char *out, size_t limit, const char *s, size_t n) {
+    size_t len = 0;
+    for (size_t i = 0; i < n && len + 6 < limit; i++) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\') {
+            out[len++] = '\\';
+            out[len++] = c;
+        } else if (c < 0x20) {
+            len += snprintf(out + len, limit - len, "\\u%04x", c);
+        } else {
+            out[len++] = c;
+        }
+    }
+    return len;
+}
+
+static void add_event(const char *name, uint64_t start, uint64_t end, int tid,
+                      const char *arg, size_t arg_len) {
+    char ev[TRACE_EVENT_MAX];
+    int len = snprintf(ev, sizeof(ev),
+                       "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                       "\"pid\":%d,\"tid\":%d",
+                       name, start / 1000.0, (end - start) / 1000.0, (int)self, tid);
+    if (arg) {
+        len += snprintf(ev + len, sizeof(ev) - len, ",\"args\":{\"cmd\":\"");
+        while (arg_len > 0 && (arg[arg_len - 1] == '\n' || arg[arg_len - 1] == '\r')) arg_len--;
+        len += json_escape(ev + len, sizeof(ev) - len - 8, arg, arg_len);
+        len += snprintf(ev + len, sizeof(ev) - len, "\"}");
+    }
+    len += snprintf(ev + len, sizeof(ev) - len, "},\n");
+
+    if (buf_len + len > sizeof(buf)) trace_flush();
+    memcpy(buf + buf_len, ev, len);
+    buf_len += len;
+}
+
+// Record a span of the shell's own work that began at start
+void trace_span(const char *name, uint64_t start, const char *arg, size_t arg_len) {
+    if (!trace_enabled) return;
+    add_event(name, start, now_ns(), self, arg, arg_len);
+}
+
+// Record a child's lifetime on its own track, ending now
+void trace_child_span(const char *name, uint64_t start, pid_t pid, const char *arg) {
+    if (!trace_enabled) return;
+    add_event(name, start, now_ns(), pid, arg, arg ? strlen(arg) : 0);
+}
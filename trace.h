@@ -0,0 +1,16 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+extern int trace_enabled;
+
+void init_trace();
+uint64_t trace_start();
+void trace_span(const char *name, uint64_t start, const char *arg, size_t arg_len);
+void trace_child_span(const char *name, uint64_t start, pid_t pid, const char *arg);
+void trace_flush();
+
+#endif
@@ -0,0 +1,496 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include "utils.h"
+
+// === Output Buffer ===
+void out_flush(struct outbuf *o) {
+    size_t off = 0;
+    while (off < o->len && !o->failed) {
+        ssize_t n = write(o->fd, o->data + off, o->len - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) o->failed = 1;
+        else off += n;
+    }
+    o->len = 0;
+}
+
+void out_write(struct outbuf *o, const char *s, size_t n) {
+    while (n > 0) {
+        if (o->len == sizeof(o->data)) out_flush(o);
+        size_t chunk = sizeof(o->data) - o->len;
+        if (chunk > n) chunk = n;
+        memcpy(o->data + o->len, s, chunk);
+        o->len += chunk;
+        s += chunk;
+        n -= chunk;
+    }
+}
+
+void out_str(struct outbuf *o, const char *s) {
+    out_write(o, s, strlen(s));
+}
+
+// Write a backslash escape sequence starting after the backslash; returns
+// the number of characters consumed, or -1 for \c (stop all output)
+int out_escape(struct outbuf *o, const char *s) {
+    char c;
+    int used = 1;
+    switch (*s) {
+    case 'a': c = '\a'; break;
+    case 'b': c = '\b'; break;
+    case 'c': return -1;
+    case 'e': c = 033; break;
+    case 'f': c = '\f'; break;
+    case 'n': c = '\n'; break;
+    case 'r': c = '\r'; break;
+    case 't': c = '\t'; break;
+    case 'v': c = '\v'; break;
+    case '\\': c = '\\'; break;
+    case '0':
+        c = 0;
+        while (used < 4 && s[used] >= '0' && s[used] <= '7') c = c * 8 + (s[used++] - '0');
+        break;
+    default:
+        out_write(o, "\\", 1);
+        return 0;
+    }
+    out_write(o, &c, 1);
+    return used;
+}
+
+// === In-Process Utilities ===
+int builtin_true(char **args, struct builtin_io *io) {
+    return 0;
+}
+
+int builtin_false(char **args, struct builtin_io *io) {
+    return 1;
+}
+
+// echo [-neE] [args...]
+int builtin_echo(char **args, struct builtin_io *io) {
+    struct outbuf o = { .fd = io->out };
+    int newline = 1, escapes = 0, i = 1;
+
+    for (; args[i] && args[i][0] == '-' && args[i][1]; i++) {
+        const char *f = args[i] + 1;
+        if (strspn(f, "neE") != strlen(f)) break;
+        for (; *f; f++) {
+            if (*f == 'n') newline = 0;
+            else escapes = *f == 'e';
+        }
+    }
+
+    for (int first = i; args[i]; i++) {
+        if (i > first) out_write(&o, " ", 1);
+        if (!escapes) {
+            out_str(&o, args[i]);
+            continue;
+        }
+        for (const char *s = args[i]; *s; s++) {
+            if (*s != '\\') {
+                out_write(&o, s, 1);
+                continue;
+            }
+            int used = out_escape(&o, s + 1);
+            if (used < 0) {
+                out_flush(&o);
+                return o.failed;
+            }
+            s += used;
+        }
+    }
+    if (newline) out_write(&o, "\n", 1);
+    out_flush(&o);
+    return o.failed;
+}
+
+int builtin_pwd(char **args, struct builtin_io *io) {
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        dprintf(io->err, "pwd: %s\n", strerror(errno));
+        return 1;
+    }
+    struct outbuf o = { .fd = io->out };
+    out_str(&o, cwd);
+    out_write(&o, "\n", 1);
+    out_flush(&o);
+    return o.failed;
+}
+
+// printf FORMAT [args...]: %s %b %c %d %i %u %o %x %X %% with flags,
+// width and precision. The format is reused while arguments remain.
+int builtin_printf(char **args, struct builtin_io *io) {
+    if (!args[1]) {
+        dprintf(io->err, "printf: missing operand\n");
+        return 1;
+    }
+
+    struct outbuf o = { .fd = io->out };
+    const char *format = args[1];
+    char **arg = &args[2];
+    int status = 0;
+
+    do {
+        char **round = arg;
+        for (const char *f = format; *f; f++) {
+            if (*f == '\\') {
+                int used = out_escape(&o, f + 1);
+                if (used < 0) goto done;
+                f += used;
+                continue;
+            }
+            if (*f != '%') {
+                out_write(&o, f, 1);
+                continue;
+            }
+            if (f[1] == '%') {
+                out_write(&o, "%", 1);
+                f++;
+                continue;
+            }
+
+            // Copy the conversion spec so snprintf can do the formatting
+            char spec[32], buf[512];
+            size_t n = strspn(f + 1, "-+ #0123456789.");
+            char conv = f[1 + n];
+            if (!conv || n + 4 > sizeof(spec) || !strchr("sbcdiuoxX", conv)) {
+                dprintf(io->err, "printf: invalid format: %s\n", f);
+                status = 1;
+                goto done;
+            }
+            const char *a = *arg ? *arg++ : "";
+            memcpy(spec, f, n + 1);
+            f += n + 1;
+
+            if (conv == 's' || conv == 'b' || conv == 'c') {
+                if (conv == 'b') {
+                    for (; *a; a++) {
+                        if (*a != '\\') {
+                            out_write(&o, a, 1);
+                        } else {
+                            int used = out_escape(&o, a + 1);
+                            if (used < 0) goto done;
+                            a += used;
+                        }
+                    }
+                    continue;
+                }
+                strcpy(spec + n + 1, "s");
+                char one[2] = { a[0], 0 };
+                snprintf(buf, sizeof(buf), spec, conv == 'c' ? one : a);
+            } else {
+                char *end;
+                errno = 0;
+                if (conv == 'd' || conv == 'i') {
+                    strcpy(spec + n + 1, "lld");
+                    snprintf(buf, sizeof(buf), spec, strtoll(a, &end, 0));
+                } else {
+                    sprintf(spec + n + 1, "ll%c", conv);
+                    snprintf(buf, sizeof(buf), spec, strtoull(a, &end, 0));
+                }
+                if (*end || errno) {
+                    dprintf(io->err, "printf: %s: invalid number\n", a);
+                    status = 1;
+                }
+            }
+            out_str(&o, buf);
+        }
+        if (arg == round) break;
+    } while (*arg);
+
+done:
+    out_flush(&o);
+    return status || o.failed;
+}
+
+// --- cat ---
+// Data moves between descriptors inside the kernel where it can:
+// copy_file_range between regular files (a reflink or server-side copy
+// on filesystems that support it), sendfile from a regular file to
+// anything, splice when either end is a pipe, and read/write otherwise.
+// A method the kernel refuses before any byte moved (EXDEV, EINVAL, an
+// O_APPEND output, ...) falls through to the next.
+#define COPY_CHUNK (1 << 30)
+
+static int unsupported(int err) {
+    return err == EXDEV || err == EINVAL || err == EBADF || err == ENOSYS || err == EOPNOTSUPP;
+}
+
+enum { COPY_RANGE, COPY_SENDFILE, COPY_SPLICE };
+
+// Copy with one kernel method. Returns 1 when done (EOF or *limit
+// reached), 0 if the method is refused before anything moved, or -1.
+static int kernel_copy(int method, int in, int out, uint64_t *limit) {
+    int moved = 0;
+    ssize_t n = 0;
+    while (*limit > 0) {
+        size_t want = *limit < COPY_CHUNK ? *limit : COPY_CHUNK;
+        if (method == COPY_RANGE) n = copy_file_range(in, NULL, out, NULL, want, 0);
+        else if (method == COPY_SENDFILE) n = sendfile(out, in, NULL, want);
+        else n = splice(in, NULL, out, NULL, want, SPLICE_F_MOVE);
+        if (n <= 0) break;
+        *limit -= n;
+        moved = 1;
+    }
+    if (*limit == 0 || n == 0) return 1;
+    return errno == EINTR || (!moved && unsupported(errno)) ? 0 : -1;
+}
+
+// Copy in to out until EOF or limit bytes. Returns 0, or -1 with errno set.
+int copy_data(int in, int out, uint64_t limit) {
+    struct stat ist, ost;
+    if (fstat(in, &ist) < 0 || fstat(out, &ost) < 0) return -1;
+
+    int r = 0;
+    if (S_ISREG(ist.st_mode) && S_ISREG(ost.st_mode)) r = kernel_copy(COPY_RANGE, in, out, &limit);
+    if (r == 0 && S_ISREG(ist.st_mode)) r = kernel_copy(COPY_SENDFILE, in, out, &limit);
+    if (r == 0 && (S_ISFIFO(ist.st_mode) || S_ISFIFO(ost.st_mode))) {
+        r = kernel_copy(COPY_SPLICE, in, out, &limit);
+    }
+    if (r != 0) return r < 0 ? -1 : 0;
+
+    ssize_t n;
+    char buf[65536];
+    while (limit > 0) {
+        n = read(in, buf, limit < sizeof(buf) ? limit : sizeof(buf));
+        if (n == 0) return 0;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        limit -= n;
+        for (ssize_t off = 0; off < n;) {
+            ssize_t w = write(out, buf + off, n - off);
+            if (w < 0 && errno == EINTR) continue;
+            if (w < 0) return -1;
+            off += w;
+        }
+    }
+    return 0;
+}
+
+// Whether path is something a builtin may read to EOF without hanging:
+// a regular file, or a name that will fail to open
+int finite_file(const char *path) {
+    struct stat st;
+    return stat(path, &st) < 0 || S_ISREG(st.st_mode);
+}
+
+// cat [file...]: '-' or no operands copies stdin
+int cat_operands(char **args) {
+    int files = 0;
+    for (int i = 1; args[i]; i++) {
+        if (args[i][0] == '-' && args[i][1]) return -1;
+        if (strcmp(args[i], "-") == 0) continue;
+        if (!finite_file(args[i])) return -1;
+        files = 1;
+    }
+    return files;
+}
+
+int builtin_cat(char **args, struct builtin_io *io) {
+    static char *stdin_only[] = { "cat", "-", NULL };
+    struct stat ost;
+    int status = 0;
+    int have_out = fstat(io->out, &ost) == 0 && S_ISREG(ost.st_mode);
+
+    if (!args[1]) args = stdin_only;
+    for (int i = 1; args[i]; i++) {
+        int in = strcmp(args[i], "-") == 0 ? io->in : open(args[i], O_RDONLY | O_CLOEXEC);
+        if (in < 0) {
+            dprintf(io->err, "cat: %s: %s\n", args[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+
+        struct stat ist;
+        if (have_out && fstat(in, &ist) == 0 && ist.st_dev == ost.st_dev &&
+            ist.st_ino == ost.st_ino && ist.st_size > 0) {
+            dprintf(io->err, "cat: %s: input file is output file\n", args[i]);
+            status = 1;
+        } else if (copy_data(in, io->out, UINT64_MAX) < 0) {
+            if (errno == EPIPE) {
+                if (in != io->in) close(in);
+                return STATUS_EPIPE;
+            }
+            dprintf(io->err, "cat: %s: %s\n", args[i], strerror(errno));
+            status = 1;
+        }
+        if (in != io->in) close(in);
+    }
+    return status;
+}
+
+// --- test / [ ---
+struct test_state {
+    char **args;
+    int pos, argc;
+    int error;
+    struct builtin_io *io;
+};
+
+static const char *test_peek(struct test_state *t, int ahead) {
+    return t->pos + ahead < t->argc ? t->args[t->pos + ahead] : NULL;
+}
+
+static int test_number(struct test_state *t, const char *s, long long *v) {
+    char *end;
+    errno = 0;
+    *v = strtoll(s, &end, 10);
+    if (!*s || *end || errno) {
+        dprintf(t->io->err, "test: %s: integer expression expected\n", s);
+        t->error = 1;
+        return 0;
+    }
+    return 1;
+}
+
+static int is_unary(const char *op) {
+    return op && op[0] == '-' && op[1] && !op[2] && strchr("bcdefghLnprsSwxz", op[1]);
+}
+
+static int is_binary(const char *op) {
+    static const char *ops[] = { "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le",
+                                 "-gt", "-ge", "-nt", "-ot", "-ef", NULL };
+    for (int i = 0; op && ops[i]; i++) {
+        if (strcmp(op, ops[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+static int test_unary(char op, const char *arg) {
+    struct stat st;
+    if (op == 'n') return *arg != 0;
+    if (op == 'z') return *arg == 0;
+    if (op == 'r') return access(arg, R_OK) == 0;
+    if (op == 'w') return access(arg, W_OK) == 0;
+    if (op == 'x') return access(arg, X_OK) == 0;
+    if (op == 'h' || op == 'L') return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+    if (stat(arg, &st) != 0) return 0;
+    switch (op) {
+    case 'b': return S_ISBLK(st.st_mode);
+    case 'c': return S_ISCHR(st.st_mode);
+    case 'd': return S_ISDIR(st.st_mode);
+    case 'f': return S_ISREG(st.st_mode);
+    case 'g': return (st.st_mode & S_ISGID) != 0;
+    case 'p': return S_ISFIFO(st.st_mode);
+    case 's': return st.st_size > 0;
+    case 'S': return S_ISSOCK(st.st_mode);
+    case 'u': return (st.st_mode & S_ISUID) != 0;
+    }
+    return 1;   // -e
+}
+
+static int test_binary(struct test_state *t, const char *a, const char *op, const char *b) {
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) return strcmp(a, b) == 0;
+    if (strcmp(op, "!=") == 0) return strcmp(a, b) != 0;
+    if (strcmp(op, "<") == 0) return strcmp(a, b) < 0;
+    if (strcmp(op, ">") == 0) return strcmp(a, b) > 0;
+
+    if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0 || strcmp(op, "-ef") == 0) {
+        struct stat sa, sb;
+        int ha = stat(a, &sa) == 0, hb = stat(b, &sb) == 0;
+        if (op[1] == 'e') return ha && hb && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+        if (!ha || !hb) return op[1] == 'n' ? ha : hb;
+        long long d = (sa.st_mtim.tv_sec - sb.st_mtim.tv_sec) * 1000000000LL +
+                      (sa.st_mtim.tv_nsec - sb.st_mtim.tv_nsec);
+        return op[1] == 'n' ? d > 0 : d < 0;
+    }
+
+    long long x, y;
+    if (!test_number(t, a, &x) || !test_number(t, b, &y)) return 0;
+    if (strcmp(op, "-eq") == 0) return x == y;
+    if (strcmp(op, "-ne") == 0) return x != y;
+    if (strcmp(op, "-lt") == 0) return x < y;
+    if (strcmp(op, "-le") == 0) return x <= y;
+    if (strcmp(op, "-gt") == 0) return x > y;
+    return x >= y;
+}
+
+static int test_or(struct test_state *t);
+
+static int test_primary(struct test_state *t) {
+    const char *a = test_peek(t, 0);
+    if (!a) {
+        dprintf(t->io->err, "test: argument expected\n");
+        t->error = 1;
+        return 0;
+    }
+
+    // Binary operators bind first so "test -n = -n" compares strings
+    if (is_binary(test_peek(t, 1)) && test_peek(t, 2)) {
+        t->pos += 3;
+        return test_binary(t, a, t->args[t->pos - 2], t->args[t->pos - 1]);
+    }
+    if (strcmp(a, "!") == 0 && test_peek(t, 1)) {
+        t->pos++;
+        return !test_primary(t);
+    }
+    if (strcmp(a, "(") == 0 && test_peek(t, 1)) {
+        t->pos++;
+        int v = test_or(t);
+        if (!test_peek(t, 0) || strcmp(test_peek(t, 0), ")") != 0) {
+            dprintf(t->io->err, "test: missing ')'\n");
+            t->error = 1;
+            return 0;
+        }
+        t->pos++;
+        return v;
+    }
+    if (is_unary(a) && test_peek(t, 1)) {
+        t->pos += 2;
+        return test_unary(a[1], t->args[t->pos - 1]);
+    }
+    t->pos++;
+    return *a != 0;
+}
+
+static int test_and(struct test_state *t) {
+    int v = test_primary(t);
+    while (!t->error && test_peek(t, 0) && strcmp(test_peek(t, 0), "-a") == 0) {
+        t->pos++;
+        v = test_primary(t) && v;
+    }
+    return v;
+}
+
+static int test_or(struct test_state *t) {
+    int v = test_and(t);
+    while (!t->error && test_peek(t, 0) && strcmp(test_peek(t, 0), "-o") == 0) {
+        t->pos++;
+        v = test_and(t) || v;
+    }
+    return v;
+}
+
+int builtin_test(char **args, struct builtin_io *io) {
+    struct test_state t = { args + 1, 0, 0, 0, io };
+    while (t.args[t.argc]) t.argc++;
+
+    if (strcmp(args[0], "[") == 0) {
+        if (t.argc == 0 || strcmp(t.args[t.argc - 1], "]") != 0) {
+            dprintf(io->err, "[: missing ']'\n");
+            return 2;
+        }
+        t.argc--;
+    }
+    if (t.argc == 0) return 1;
+
+    int v = test_or(&t);
+    if (!t.error && t.pos < t.argc) {
+        dprintf(io->err, "test: %s: unexpected argument\n", t.args[t.pos]);
+        t.error = 1;
+    }
+    if (t.error) return 2;
+    return !v;
+}
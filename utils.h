@@ -0,0 +1,39 @@
+#ifndef UTILS_H
+#define UTILS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "builtins.h"
+
+// What a command killed by SIGPIPE reports; in-process utilities return
+// it when their reader goes away
+#define STATUS_EPIPE (128 + 13)
+
+// Small write buffer so a builtin's output costs one write() per 4 KiB
+struct outbuf {
+    int fd;
+    int failed;
+    size_t len;
+    char data[4096];
+};
+
+void out_flush(struct outbuf *o);
+void out_write(struct outbuf *o, const char *s, size_t n);
+void out_str(struct outbuf *o, const char *s);
+int out_escape(struct outbuf *o, const char *s);
+
+int copy_data(int in, int out, uint64_t limit);
+int finite_file(const char *path);
+
+// In-process utilities: no effect on shell state, so they can run as
+// pipeline-stage threads and inside embedded engines
+int builtin_true(char **args, struct builtin_io *io);
+int builtin_false(char **args, struct builtin_io *io);
+int builtin_echo(char **args, struct builtin_io *io);
+int builtin_pwd(char **args, struct builtin_io *io);
+int builtin_printf(char **args, struct builtin_io *io);
+int builtin_test(char **args, struct builtin_io *io);
+int builtin_cat(char **args, struct builtin_io *io);
+int cat_operands(char **args);
+
+#endif
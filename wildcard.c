@@ -0,0 +1,292 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "wildcard.h"
+#include "parse.h"
+#include "trace.h"
+
+// === Directory Cache ===
+// Globs read directories with getdents64 into a cache of names, so every
+// glob in a pipeline's words scans a directory once, however many
+// patterns are matched against it. The cache is cleared before each
+// pipeline is expanded and after each command substitution, since either
+// may follow commands that changed the directories.
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+struct dir_entry {
+    const char *name;
+    size_t len;
+    unsigned char type;     // DT_*, DT_UNKNOWN if the filesystem does not say
+};
+
+struct dir_listing {
+    const char *path;
+    struct dir_entry *entries;
+    size_t n;
+    struct dir_listing *next;
+};
+
+static struct arena cache_arena;
+static struct dir_listing *listings;
+static char *read_buf;
+
+void dir_cache_clear() {
+    for (struct dir_listing *l = listings; l; l = l->next) free(l->entries);
+    listings = NULL;
+    arena_reset(&cache_arena);
+}
+
+// The entries of directory path ("" for the cwd) other than . and ..; a
+// directory that cannot be read has none
+static struct dir_listing *list_dir(const char *path) {
+    for (struct dir_listing *l = listings; l; l = l->next) {
+        if (strcmp(l->path, path) == 0) return l;
+    }
+
+    struct dir_listing *l = arena_alloc(&cache_arena, sizeof(*l));
+    l->path = arena_strndup(&cache_arena, path, strlen(path));
+    l->entries = NULL;
+    l->n = 0;
+    l->next = listings;
+    listings = l;
+
+    uint64_t t0 = trace_start();
+    int fd = open(*path ? path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return l;
+    if (!read_buf && !(read_buf = malloc(DIR_READ_SIZE))) {
+        perror("glob allocation failed");
+        exit(1);
+    }
+
+    size_t cap = 0;
+    long n;
+    while ((n = syscall(SYS_getdents64, fd, read_buf, DIR_READ_SIZE)) > 0) {
+        for (long off = 0; off < n;) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(read_buf + off);
+            off += d->d_reclen;
+            const char *name = d->d_name;
+            if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]))) continue;
+
+            if (l->n == cap) {
+                cap = cap ? cap * 2 : 64;
+                l->entries = realloc(l->entries, cap * sizeof(*l->entries));
+                if (!l->entries) {
+                    perror("glob allocation failed");
+                    exit(1);
+                }
+            }
+            struct dir_entry *e = &l->entries[l->n++];
+            e->len = strlen(name);
+            e->name = arena_strndup(&cache_arena, name, e->len);
+            e->type = d->d_type;
+        }
+    }
+    close(fd);
+    trace_span("readdir", t0, path, strlen(path));
+    return l;
+}
+
+// === Matching ===
+// Patterns are word bytes: '*', '?' and bracket expressions match, and
+// WORD_ESCAPE makes the byte after it literal.
+static const struct {
+    const char *name;
+    int (*fn)(int);
+} classes[] = {
+    { "alnum", isalnum }, { "alpha", isalpha }, { "blank", isblank }, { "cntrl", iscntrl },
+    { "digit", isdigit }, { "graph", isgraph }, { "lower", islower }, { "print", isprint },
+    { "punct", ispunct }, { "space", isspace }, { "upper", isupper }, { "xdigit", isxdigit },
+};
+
+// Whether c is in the bracket expression b of length len
+static int in_bracket(const char *b, size_t len, unsigned char c) {
+    size_t i = 1, end = len - 1;
+    int negate = b[i] == '!' || b[i] == '^';
+    if (negate) i++;
+
+    int found = 0;
+    while (i < end) {
+        if (b[i] == '[' && b[i + 1] == ':') {
+            const char *close = strstr(b + i + 2, ":]");
+            size_t n = close - (b + i + 2);
+            for (size_t k = 0; k < sizeof(classes) / sizeof(classes[0]); k++) {
+                if (strlen(classes[k].name) == n && memcmp(classes[k].name, b + i + 2, n) == 0 &&
+                    classes[k].fn(c)) {
+                    found = 1;
+                }
+            }
+            i = close + 2 - b;
+            continue;
+        }
+        if (b[i] == WORD_ESCAPE) i++;
+        unsigned char lo = b[i++], hi = lo;
+        if (i + 1 < end && b[i] == '-') {
+            i++;
+            if (b[i] == WORD_ESCAPE) i++;
+            hi = b[i++];
+        }
+        if (c >= lo && c <= hi) found = 1;
+    }
+    return found != negate;
+}
+
+// Whether name matches the pattern component pat. A leading '.' in name
+// must be matched by a literal one. A '*' that fails to extend a match
+// resumes from the most recent '*' only, so matching is linear in the
+// common cases.
+static int match(const char *pat, size_t len, const char *name) {
+    if (name[0] == '.') {
+        size_t k = len > 0 && pat[0] == WORD_ESCAPE ? 1 : 0;
+        if (k >= len || pat[k] != '.') return 0;
+    }
+
+    size_t p = 0, star_p = 0;
+    const char *n = name, *star_n = NULL;
+    while (*n) {
+        if (p < len) {
+            char c = pat[p];
+            if (c == '*') {
+                star_p = ++p;
+                star_n = n;
+                continue;
+            }
+            if (c == '?') {
+                p++;
+                n++;
+                continue;
+            }
+            size_t bl = c == '[' ? bracket_len(pat + p, len - p) : 0;
+            if (bl) {
+                if (in_bracket(pat + p, bl, *n)) {
+                    p += bl;
+                    n++;
+                    continue;
+                }
+            } else {
+                size_t q = c == WORD_ESCAPE && p + 1 < len ? p + 1 : p;
+                if (pat[q] == *n) {
+                    p = q + 1;
+                    n++;
+                    continue;
+                }
+            }
+        }
+        if (!star_n) return 0;
+        p = star_p;
+        n = ++star_n;
+    }
+    while (p < len && pat[p] == '*') p++;
+    return p == len;
+}
+
+// === Expansion ===
+struct glob_state {
+    struct arena *a;
+    char **v;
+    size_t n;
+    size_t cap;
+    char *path;             // the path matched so far
+    size_t path_cap;
+};
+
+static void path_put(struct glob_state *g, size_t at, const char *s, size_t n) {
+    if (at + n + 1 > g->path_cap) {
+        while (at + n + 1 > g->path_cap) g->path_cap = g->path_cap ? g->path_cap * 2 : 256;
+        g->path = realloc(g->path, g->path_cap);
+        if (!g->path) {
+            perror("glob allocation failed");
+            exit(1);
+        }
+    }
+    memcpy(g->path + at, s, n);
+    g->path[at + n] = '\0';
+}
+
+static void add_match(struct glob_state *g, size_t len) {
+    if (g->n == g->cap) {
+        g->cap = g->cap ? g->cap * 2 : 16;
+        g->v = realloc(g->v, g->cap * sizeof(char *));
+        if (!g->v) {
+            perror("glob allocation failed");
+            exit(1);
+        }
+    }
+    g->v[g->n++] = arena_strndup(g->a, g->path, len);
+}
+
+// Whether entry e, whose path is g->path, is a directory (or a link to one)
+static int is_dir(struct glob_state *g, const struct dir_entry *e) {
+    if (e->type == DT_DIR) return 1;
+    if (e->type != DT_UNKNOWN && e->type != DT_LNK) return 0;
+    struct stat st;
+    return stat(g->path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// Match the rest of the pattern, pat, below the first at bytes of
+// g->path. Components without glob characters are taken as they are;
+// a literal last one must exist.
+static void walk(struct glob_state *g, size_t at, const char *pat, size_t len) {
+    const char *slash = memchr(pat, '/', len);
+    size_t clen = slash ? (size_t)(slash - pat) : len;
+
+    if (!word_has_glob(pat, clen)) {
+        size_t end = at;
+        for (size_t i = 0; i < clen; i++) {
+            if (pat[i] == WORD_ESCAPE && i + 1 < clen) i++;
+            path_put(g, end++, pat + i, 1);
+        }
+        path_put(g, end, "", 0);
+        struct stat st;
+        if (slash) {
+            path_put(g, end, "/", 1);
+            walk(g, end + 1, slash + 1, len - clen - 1);
+        } else if (lstat(g->path, &st) == 0) {
+            add_match(g, end);
+        }
+        return;
+    }
+
+    path_put(g, at, "", 0);
+    struct dir_listing *l = list_dir(g->path);
+    for (size_t i = 0; i < l->n; i++) {
+        const struct dir_entry *e = &l->entries[i];
+        if (!match(pat, clen, e->name)) continue;
+        path_put(g, at, e->name, e->len);
+        if (!slash) {
+            add_match(g, at + e->len);
+        } else if (is_dir(g, e)) {
+            path_put(g, at + e->len, "/", 1);
+            walk(g, at + e->len + 1, slash + 1, len - clen - 1);
+        }
+    }
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// The paths matching pattern, in a, sorted bytewise (as in the C locale).
+// Returns a malloc'd array of *count paths, or NULL if nothing matches.
+char **glob_paths(struct arena *a, const char *pattern, size_t len, size_t *count) {
+    struct glob_state g = { .a = a };
+    walk(&g, 0, pattern, len);
+    free(g.path);
+    if (g.n > 1) qsort(g.v, g.n, sizeof(char *), compare_paths);
+    *count = g.n;
+    return g.v;
+}
@@ -0,0 +1,13 @@
+#ifndef WILDCARD_H
+#define WILDCARD_H
+
+#include <stddef.h>
+#include "arena.h"
+
+// Read buffer for one getdents64() call
+#define DIR_READ_SIZE (256 * 1024)
+
+char **glob_paths(struct arena *a, const char *pattern, size_t len, size_t *count);
+void dir_cache_clear();
+
+#endif